@@ -33,12 +33,20 @@ public:
 
 		const auto& vertexShaderSource = ReadFile("assets/shaders/vert.spv");
 		const auto& fragmentShaderSource = ReadFile("assets/shaders/frag.spv");
+		const auto& particleVertexShaderSource = ReadFile("assets/shaders/particle_vert.spv");
+		const auto& particleComputeShaderSource = ReadFile("assets/shaders/particle_comp.spv");
 
 		context_->Initialize(appWindow_, {static_cast<uint32_t>(width), static_cast<uint32_t>(height)},
-		                     vk::Format::eB8G8R8A8Unorm, vertexShaderSource, fragmentShaderSource, VIEWPORT_MIN_DEPTH,
-		                     VIEWPORT_MAX_DEPTH, MAX_FRAMES_IN_FLIGHT);
+		                     vk::Format::eB8G8R8A8Unorm, vertexShaderSource, fragmentShaderSource,
+		                     particleVertexShaderSource, particleComputeShaderSource, VIEWPORT_MIN_DEPTH, VIEWPORT_MAX_DEPTH, MAX_FRAMES_IN_FLIGHT);
 
-		scene_ = std::make_shared<Scene>(MAX_FRAMES_IN_FLIGHT);
+		renderingEngine_ = std::make_shared<VulkanRenderingEngine>(context_, MAX_FRAMES_IN_FLIGHT);
+
+		// Textures are decoded on the loader's own thread, and drawn with a placeholder until then. Their mipmaps are
+		// generated on the rendering engine's worker threads.
+		scene_ = std::make_shared<Scene>(MAX_FRAMES_IN_FLIGHT, std::make_shared<TextureLoader>(
+			                                 context_->GetDeviceContext(), context_->GetCommandPool(),
+			                                 renderingEngine_->GetJobSystem()));
 		scene_->SetSwapchainExtent(context_->GetSwapchainExtent());
 
 		// TODO: [zpuls 2020-08-08T18:07] Allow for dynamic descriptor set layouts based on shader/material, not just relying on the default one created during VulkanContext::Initialize().
@@ -53,9 +61,7 @@ public:
 		auto particleEffectTexture = scene_->AddTexture("assets/textures/particle/texture.png", context_);
 		// TODO: [zpuls 2020-08-08T20:53] More error-handling with Transform, allow the user to add no rotation/no translation/no scale, etc, without getting -NaN values in the resulting glm::mat4 (Model Matrix)
 		auto particleEffectTransform = scene_->AddTransform(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f, glm::vec3(1.0f));
- 		particleEffect_ = scene_->AddParticleEffect(particleEffectTexture, particleEffectTransform, glm::vec3(0.0f, 0.0f, 1.0f), 5, 0.1f, context_, particleEffectDescriptorSet);
-
-		renderingEngine_ = std::make_shared<VulkanRenderingEngine>(context_, MAX_FRAMES_IN_FLIGHT);
+ 		particleEffect_ = scene_->AddParticleEffect(particleEffectTexture, particleEffectTransform, glm::vec3(0.0f, 0.0f, 1.0f), ParticleEmitter(0.25f, 5, 5), 0.1f, context_, particleEffectDescriptorSet);
 
 		renderingEngine_->UpdateScene(scene_);
 	}
@@ -0,0 +1,459 @@
+#pragma once
+
+#include "stdafx.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+// CPU encoders for the block-compressed formats TextureCooker can write: BC1 (RGB with 1-bit alpha, 8 bytes per 4x4
+// block), BC3 (BC1 color plus interpolated alpha, 16 bytes) and BC7 (16 bytes, mode 6 only: one RGBA subset with 4-bit
+// indices). Endpoints are fit along each block's principal axis, which is close to the fast mode of dedicated encoders,
+// at a fraction of the code.
+class BlockCompression
+{
+public:
+	// 16 RGBA8 texels, row-major.
+	using Block = std::array<unsigned char, 64>;
+
+	static bool IsSupported(const vk::Format format)
+	{
+		return format == vk::Format::eBc1RgbaUnormBlock || format == vk::Format::eBc3UnormBlock ||
+			format == vk::Format::eBc7UnormBlock;
+	}
+
+	static size_t GetBlockSize(const vk::Format format)
+	{
+		return format == vk::Format::eBc1RgbaUnormBlock ? 8 : 16;
+	}
+
+	// Compresses one level of RGBA8 pixels, one job per row of blocks. Blocks that overhang the level repeat its last row
+	// and column.
+	static std::vector<unsigned char> Compress(const vk::Format format, const unsigned char* pixels,
+	                                           const vk::Extent2D extent, JobSystem& jobSystem)
+	{
+		if (!IsSupported(format))
+		{
+			throw std::runtime_error("Could not compress texture, unsupported format [" + vk::to_string(format) + "].");
+		}
+
+		const auto blocksX = (extent.width + 3) / 4;
+		const auto blocksY = (extent.height + 3) / 4;
+		const auto blockSize = GetBlockSize(format);
+		std::vector<unsigned char> data(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+		JobSystem::Counter counter;
+		jobSystem.ParallelFor(0, blocksY, 1, [format, pixels, extent, blocksX, blockSize, &data](
+			                      const uint32_t begin, const uint32_t end)
+		                      {
+			                      for (auto blockY = begin; blockY < end; ++blockY)
+			                      {
+				                      for (uint32_t blockX = 0; blockX < blocksX; ++blockX)
+				                      {
+					                      const auto block = fetchBlock_(pixels, extent, blockX, blockY);
+					                      auto* out = &data[(static_cast<size_t>(blockY) * blocksX + blockX) * blockSize];
+					                      encode_(format, block, out);
+				                      }
+			                      }
+		                      }, counter);
+		jobSystem.Wait(counter);
+		return data;
+	}
+
+	static void EncodeBC1(const Block& block, unsigned char* out)
+	{
+		encodeColor_(block, out, true);
+	}
+
+	static void EncodeBC3(const Block& block, unsigned char* out)
+	{
+		encodeAlpha_(block, out);
+		encodeColor_(block, out + 8, false);
+	}
+
+	static void EncodeBC7(const Block& block, unsigned char* out)
+	{
+		std::array<float, 4> mean{};
+		std::array<float, 4> axis{};
+		principalAxis_(block, mean, axis);
+		float minProjection, maxProjection;
+		projectionRange_(block, mean, axis, minProjection, maxProjection);
+
+		// Mode 6 endpoints are 7 bits per channel, plus one p-bit per endpoint shared by its four channels.
+		std::array<std::array<uint32_t, 4>, 2> endpoints{};
+		std::array<uint32_t, 2> pBits{};
+		std::array<std::array<float, 4>, 2> colors{};
+		for (size_t i = 0; i < 2; ++i)
+		{
+			const auto projection = i == 0 ? minProjection : maxProjection;
+			std::array<float, 4> target{};
+			for (size_t c = 0; c < 4; ++c)
+			{
+				target[c] = std::clamp(mean[c] + axis[c] * projection, 0.0f, 255.0f);
+			}
+
+			auto bestError = -1.0f;
+			for (uint32_t pBit = 0; pBit < 2; ++pBit)
+			{
+				std::array<uint32_t, 4> quantized{};
+				auto error = 0.0f;
+				for (size_t c = 0; c < 4; ++c)
+				{
+					quantized[c] = static_cast<uint32_t>(std::clamp(
+						std::lround((target[c] - static_cast<float>(pBit)) / 2.0f), 0L, 127L));
+					const auto value = static_cast<float>(quantized[c] << 1 | pBit) - target[c];
+					error += value * value;
+				}
+
+				if (bestError < 0.0f || error < bestError)
+				{
+					bestError = error;
+					endpoints[i] = quantized;
+					pBits[i] = pBit;
+				}
+			}
+
+			for (size_t c = 0; c < 4; ++c)
+			{
+				colors[i][c] = static_cast<float>(endpoints[i][c] << 1 | pBits[i]);
+			}
+		}
+
+		static const std::array<uint32_t, 16> WEIGHTS = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+		std::array<std::array<float, 4>, 16> palette{};
+		for (size_t i = 0; i < palette.size(); ++i)
+		{
+			for (size_t c = 0; c < 4; ++c)
+			{
+				palette[i][c] = static_cast<float>(((64 - WEIGHTS[i]) * static_cast<uint32_t>(colors[0][c]) +
+					WEIGHTS[i] * static_cast<uint32_t>(colors[1][c]) + 32) >> 6);
+			}
+		}
+
+		std::array<uint32_t, 16> indices{};
+		for (size_t texel = 0; texel < 16; ++texel)
+		{
+			indices[texel] = nearest_<4>(&block[texel * 4], palette.data(), palette.size());
+		}
+
+		// The first index is stored with an implicit zero high bit, so its endpoints are swapped if it would need one.
+		if (indices[0] >= 8)
+		{
+			std::swap(endpoints[0], endpoints[1]);
+			std::swap(pBits[0], pBits[1]);
+			for (auto& index : indices)
+			{
+				index = 15 - index;
+			}
+		}
+
+		std::fill(out, out + 16, static_cast<unsigned char>(0));
+		uint32_t bit = 0;
+		writeBits_(out, bit, 1 << 6, 7);
+		for (size_t c = 0; c < 4; ++c)
+		{
+			writeBits_(out, bit, endpoints[0][c], 7);
+			writeBits_(out, bit, endpoints[1][c], 7);
+		}
+		writeBits_(out, bit, pBits[0], 1);
+		writeBits_(out, bit, pBits[1], 1);
+		writeBits_(out, bit, indices[0], 3);
+		for (size_t texel = 1; texel < 16; ++texel)
+		{
+			writeBits_(out, bit, indices[texel], 4);
+		}
+	}
+
+private:
+	static void encode_(const vk::Format format, const Block& block, unsigned char* out)
+	{
+		switch (format)
+		{
+		case vk::Format::eBc1RgbaUnormBlock:
+			EncodeBC1(block, out);
+			break;
+		case vk::Format::eBc3UnormBlock:
+			EncodeBC3(block, out);
+			break;
+		default:
+			EncodeBC7(block, out);
+			break;
+		}
+	}
+
+	static Block fetchBlock_(const unsigned char* pixels, const vk::Extent2D extent, const uint32_t blockX,
+	                         const uint32_t blockY)
+	{
+		Block block{};
+		for (uint32_t y = 0; y < 4; ++y)
+		{
+			const auto sourceY = std::min(blockY * 4 + y, extent.height - 1);
+			for (uint32_t x = 0; x < 4; ++x)
+			{
+				const auto sourceX = std::min(blockX * 4 + x, extent.width - 1);
+				std::copy_n(&pixels[(static_cast<size_t>(sourceY) * extent.width + sourceX) * 4], 4,
+				            &block[(y * 4 + x) * 4]);
+			}
+		}
+		return block;
+	}
+
+	// Mean of the block's first Channels channels, and the direction they vary most along, by power iteration on their
+	// covariance. The axis is zero only for a uniform block.
+	template <size_t Channels>
+	static void principalAxis_(const Block& block, std::array<float, Channels>& mean, std::array<float, Channels>& axis)
+	{
+		mean.fill(0.0f);
+		for (size_t texel = 0; texel < 16; ++texel)
+		{
+			for (size_t c = 0; c < Channels; ++c)
+			{
+				mean[c] += static_cast<float>(block[texel * 4 + c]) / 16.0f;
+			}
+		}
+
+		std::array<std::array<float, Channels>, Channels> covariance{};
+		for (size_t texel = 0; texel < 16; ++texel)
+		{
+			for (size_t i = 0; i < Channels; ++i)
+			{
+				for (size_t j = 0; j < Channels; ++j)
+				{
+					covariance[i][j] += (static_cast<float>(block[texel * 4 + i]) - mean[i]) *
+						(static_cast<float>(block[texel * 4 + j]) - mean[j]);
+				}
+			}
+		}
+
+		// Seeding with a fixed vector, e.g. all ones, fails when that vector is orthogonal to every principal axis, like
+		// for a red to green gradient. The row of the largest variance is the covariance applied to that channel's unit
+		// vector, which is only zero when the block is uniform.
+		size_t largest = 0;
+		auto trace = 0.0f;
+		for (size_t i = 0; i < Channels; ++i)
+		{
+			trace += covariance[i][i];
+			if (covariance[i][i] > covariance[largest][largest])
+			{
+				largest = i;
+			}
+		}
+
+		if (trace <= 0.0f)
+		{
+			axis.fill(0.0f);
+			return;
+		}
+
+		auto seedLength = 0.0f;
+		for (size_t i = 0; i < Channels; ++i)
+		{
+			seedLength += covariance[largest][i] * covariance[largest][i];
+		}
+		for (size_t i = 0; i < Channels; ++i)
+		{
+			axis[i] = covariance[largest][i] / std::sqrt(seedLength);
+		}
+
+		for (uint32_t iteration = 0; iteration < 8; ++iteration)
+		{
+			std::array<float, Channels> next{};
+			auto length = 0.0f;
+			for (size_t i = 0; i < Channels; ++i)
+			{
+				for (size_t j = 0; j < Channels; ++j)
+				{
+					next[i] += covariance[i][j] * axis[j];
+				}
+				length += next[i] * next[i];
+			}
+
+			if (length <= 0.0f)
+			{
+				break;
+			}
+
+			for (size_t i = 0; i < Channels; ++i)
+			{
+				axis[i] = next[i] / std::sqrt(length);
+			}
+		}
+	}
+
+	template <size_t Channels>
+	static void projectionRange_(const Block& block, const std::array<float, Channels>& mean,
+	                             const std::array<float, Channels>& axis, float& minProjection, float& maxProjection,
+	                             const bool skipTransparent = false)
+	{
+		minProjection = 0.0f;
+		maxProjection = 0.0f;
+		for (size_t texel = 0; texel < 16; ++texel)
+		{
+			if (skipTransparent && block[texel * 4 + 3] < ALPHA_THRESHOLD)
+			{
+				continue;
+			}
+
+			auto projection = 0.0f;
+			for (size_t c = 0; c < Channels; ++c)
+			{
+				projection += (static_cast<float>(block[texel * 4 + c]) - mean[c]) * axis[c];
+			}
+			minProjection = std::min(minProjection, projection);
+			maxProjection = std::max(maxProjection, projection);
+		}
+	}
+
+	// Index of the palette entry closest to texel, comparing its first Channels channels.
+	template <size_t Channels>
+	static uint32_t nearest_(const unsigned char* texel, const std::array<float, Channels>* palette,
+	                         const size_t paletteSize)
+	{
+		uint32_t best = 0;
+		auto bestError = -1.0f;
+		for (size_t i = 0; i < paletteSize; ++i)
+		{
+			auto error = 0.0f;
+			for (size_t c = 0; c < Channels; ++c)
+			{
+				const auto difference = static_cast<float>(texel[c]) - palette[i][c];
+				error += difference * difference;
+			}
+
+			if (bestError < 0.0f || error < bestError)
+			{
+				bestError = error;
+				best = static_cast<uint32_t>(i);
+			}
+		}
+		return best;
+	}
+
+	static uint16_t toRgb565_(const float r, const float g, const float b)
+	{
+		const auto quantize = [](const float value, const float max)
+		{
+			return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 255.0f) * max / 255.0f));
+		};
+		return static_cast<uint16_t>(quantize(r, 31.0f) << 11 | quantize(g, 63.0f) << 5 | quantize(b, 31.0f));
+	}
+
+	static std::array<float, 3> fromRgb565_(const uint16_t color)
+	{
+		const auto r = color >> 11 & 31;
+		const auto g = color >> 5 & 63;
+		const auto b = color & 31;
+		return {
+			static_cast<float>(r << 3 | r >> 2), static_cast<float>(g << 2 | g >> 4), static_cast<float>(b << 3 | b >> 2)
+		};
+	}
+
+	// BC1 blocks with color0 <= color1 have three colors plus transparent black, which BC1 uses for texels with alpha
+	// below ALPHA_THRESHOLD. The color block of BC3 always has four colors.
+	static void encodeColor_(const Block& block, unsigned char* out, const bool isBC1)
+	{
+		auto hasTransparent = false;
+		for (size_t texel = 0; isBC1 && texel < 16; ++texel)
+		{
+			hasTransparent |= block[texel * 4 + 3] < ALPHA_THRESHOLD;
+		}
+
+		std::array<float, 3> mean{};
+		std::array<float, 3> axis{};
+		principalAxis_(block, mean, axis);
+		float minProjection, maxProjection;
+		projectionRange_(block, mean, axis, minProjection, maxProjection, hasTransparent);
+
+		auto color0 = toRgb565_(mean[0] + axis[0] * maxProjection, mean[1] + axis[1] * maxProjection,
+		                        mean[2] + axis[2] * maxProjection);
+		auto color1 = toRgb565_(mean[0] + axis[0] * minProjection, mean[1] + axis[1] * minProjection,
+		                        mean[2] + axis[2] * minProjection);
+		if (hasTransparent ? color0 > color1 : color0 < color1)
+		{
+			std::swap(color0, color1);
+		}
+
+		const auto fourColors = !isBC1 || color0 > color1;
+		std::array<std::array<float, 3>, 4> palette = {fromRgb565_(color0), fromRgb565_(color1)};
+		for (size_t c = 0; c < 3; ++c)
+		{
+			if (fourColors)
+			{
+				palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+				palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+			}
+		}
+
+		uint32_t indices = 0;
+		for (size_t texel = 0; texel < 16; ++texel)
+		{
+			const auto index = hasTransparent && block[texel * 4 + 3] < ALPHA_THRESHOLD
+				                   ? 3
+				                   : nearest_<3>(&block[texel * 4], palette.data(), fourColors ? 4 : 3);
+			indices |= index << (texel * 2);
+		}
+
+		out[0] = static_cast<unsigned char>(color0 & 0xFF);
+		out[1] = static_cast<unsigned char>(color0 >> 8);
+		out[2] = static_cast<unsigned char>(color1 & 0xFF);
+		out[3] = static_cast<unsigned char>(color1 >> 8);
+		for (size_t i = 0; i < 4; ++i)
+		{
+			out[4 + i] = static_cast<unsigned char>(indices >> (i * 8) & 0xFF);
+		}
+	}
+
+	// The BC4 alpha block of BC3, always in its eight-value mode.
+	static void encodeAlpha_(const Block& block, unsigned char* out)
+	{
+		uint32_t alpha0 = 0;
+		uint32_t alpha1 = 255;
+		for (size_t texel = 0; texel < 16; ++texel)
+		{
+			alpha0 = std::max<uint32_t>(alpha0, block[texel * 4 + 3]);
+			alpha1 = std::min<uint32_t>(alpha1, block[texel * 4 + 3]);
+		}
+
+		uint64_t indices = 0;
+		if (alpha0 > alpha1)
+		{
+			std::array<std::array<float, 1>, 8> palette{};
+			palette[0][0] = static_cast<float>(alpha0);
+			palette[1][0] = static_cast<float>(alpha1);
+			for (uint32_t i = 2; i < 8; ++i)
+			{
+				palette[i][0] = static_cast<float>(((8 - i) * alpha0 + (i - 1) * alpha1) / 7);
+			}
+
+			for (size_t texel = 0; texel < 16; ++texel)
+			{
+				indices |= static_cast<uint64_t>(nearest_<1>(&block[texel * 4 + 3], palette.data(), palette.size())) <<
+					(texel * 3);
+			}
+		}
+
+		out[0] = static_cast<unsigned char>(alpha0);
+		out[1] = static_cast<unsigned char>(alpha1);
+		for (size_t i = 0; i < 6; ++i)
+		{
+			out[2 + i] = static_cast<unsigned char>(indices >> (i * 8) & 0xFF);
+		}
+	}
+
+	// Writes the low count bits of value at bit, least significant bit first, and advances bit past them.
+	static void writeBits_(unsigned char* out, uint32_t& bit, const uint32_t value, const uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; ++i, ++bit)
+		{
+			out[bit / 8] |= static_cast<unsigned char>((value >> i & 1) << (bit % 8));
+		}
+	}
+
+	static const inline unsigned char ALPHA_THRESHOLD = 128;
+};
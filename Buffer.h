@@ -1,9 +1,13 @@
 #pragma once
 
 #include "stdafx.h"
+#include "MemoryAllocator.h"
+#include "TransferManager.h"
 #include "Util.h"
 
-class Buffer
+#include <memory>
+
+class Buffer : public std::enable_shared_from_this<Buffer>
 {
 public:
 	explicit Buffer(const VulkanDeviceContext deviceContext,
@@ -20,15 +24,15 @@ public:
 		bufferHandle_ = deviceContext_.LogicalDevice->createBuffer(bufferCreateInfo);
 		const auto memoryRequirements = deviceContext_.LogicalDevice->getBufferMemoryRequirements(bufferHandle_);
 
-		const vk::MemoryAllocateInfo memoryAllocateInfo(memoryRequirements.size,
-		                                                Util::FindSupportedMemoryType(deviceContext_,
-		                                                                              memoryRequirements.memoryTypeBits,
-		                                                                              memoryFlags));
-
-		WRAP_VK_MEMORY_EXCEPTIONS(memoryHandle_ = deviceContext_.LogicalDevice->allocateMemory(memoryAllocateInfo),
-		                          "Buffer::Buffer() - vk::Device::allocateMemory()")
+		allocation_ = deviceContext_.Allocator->Allocate(memoryRequirements, memoryFlags,
+		                                                 MemoryAllocator::ResourceType::Linear);
+		deviceContext_.LogicalDevice->bindBufferMemory(bufferHandle_, allocation_.Memory, allocation_.Offset);
 
-		deviceContext_.LogicalDevice->bindBufferMemory(bufferHandle_, memoryHandle_, 0);
+		// Host-visible buffers stay mapped for their whole lifetime, so writes never go through vk::Device::mapMemory().
+		if (memoryFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+		{
+			mappedData_ = map_();
+		}
 	}
 
 	~Buffer()
@@ -37,7 +41,11 @@ public:
 		
 		if (deviceContext_.LogicalDevice != nullptr) {
 			deviceContext_.LogicalDevice->destroyBuffer(bufferHandle_);
-			deviceContext_.LogicalDevice->freeMemory(memoryHandle_);
+			if (mappedData_ != nullptr)
+			{
+				unmap_();
+			}
+			deviceContext_.Allocator->Free(allocation_);
 		}
 	}
 
@@ -46,45 +54,103 @@ public:
 		DebugMessage("Buffer::Fill(\"" + debugName_ + "\")");
 		// TODO: [zpuls 2020-07-31T17:23] Figure out a better way to do dynamic buffer resizing/mapping and element insertion/removal, \
 											instead of just creating a static buffer with a set size, and hoping the user always passes in the correct amount of data.
-		const auto ptr = map_(size, data, offset);
-		memcpy(ptr, data, static_cast<size_t>(size));
-		unmap_();
+		memcpy(static_cast<char*>(GetMappedData()) + offset, data, static_cast<size_t>(size));
+		Flush(offset, size);
 	}
 
-	void CopyTo(const std::shared_ptr<Buffer>& destination) const
+	// Stable pointer to the start of the buffer, valid for the buffer's whole lifetime. Only eHostVisible buffers are
+	// mapped.
+	void* GetMappedData() const
 	{
-		DebugMessage("Buffer::CopyTo(\"" + debugName_ + "\", \"" + destination->debugName_ + "\" Buffer<T>)");
-		// TODO: [zpuls 2020-07-31T17:40] Add error-handling for buffer destination that does not have the same size.
-		auto commandBuffers = deviceContext_.LogicalDevice->allocateCommandBuffersUnique({ commandPool_.get(), {}, 1 });
-		auto& commandBuffer = commandBuffers[0];
-		commandBuffer->begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+		if (mappedData_ == nullptr)
+		{
+			throw std::runtime_error("Could not access mapped data of Buffer \"" + debugName_ +
+				"\", it was not created with vk::MemoryPropertyFlagBits::eHostVisible.");
+		}
+
+		return mappedData_;
+	}
+
+	// Makes writes through GetMappedData() visible to the device. Only needed when the buffer did not ask for
+	// eHostCoherent memory, Fill() already does this.
+	void Flush(const vk::DeviceSize offset = 0, const vk::DeviceSize size = VK_WHOLE_SIZE) const
+	{
+		deviceContext_.Allocator->Flush(allocation_, offset, size == VK_WHOLE_SIZE ? bufferSize_ - offset : size);
+	}
+
+	// Copies go through the device's TransferManager and never block. The source buffer is kept alive until the copy has
+	// executed; the returned handle can be polled or waited on, if the caller needs the result on the CPU.
+	TransferManager::Handle CopyTo(const std::shared_ptr<Buffer>& destination) const
+	{
+		return CopyTo(destination, bufferSize_);
+	}
 
-		vk::BufferCopy bufferCopy({}, {}, bufferSize_);
-		commandBuffer->copyBuffer(bufferHandle_, destination->GetHandle(), 1, &bufferCopy);
+	// Copies only the first size bytes, e.g. the live part of a buffer that is sized for its maximum capacity. Throws if
+	// either buffer is smaller than size.
+	TransferManager::Handle CopyTo(const std::shared_ptr<Buffer>& destination, const vk::DeviceSize size) const
+	{
+		DebugMessage("Buffer::CopyTo(\"" + debugName_ + "\", \"" + destination->debugName_ + "\" Buffer<T>)");
+		if (size > bufferSize_ || size > destination->bufferSize_)
+		{
+			throw std::runtime_error("Could not copy [" + std::to_string(size) + "] bytes from Buffer \"" + debugName_ +
+				"\" of [" + std::to_string(bufferSize_) + "] bytes to Buffer \"" + destination->debugName_ + "\" of [" +
+				std::to_string(destination->bufferSize_) + "] bytes.");
+		}
 
-		commandBuffer->end();
-		vk::SubmitInfo submitInfo({}, {}, {}, 1, &commandBuffer.get());
-		deviceContext_.GraphicsQueue->submit(1, &submitInfo, nullptr);
-		deviceContext_.GraphicsQueue->waitIdle();
+		auto& transfers = *deviceContext_.Transfers;
+		const auto handle = destination->RecordWrite(0, size, [this, &transfers, &destination, size]
+		{
+			return transfers.Record([this, &destination, size](const vk::CommandBuffer commandBuffer)
+			{
+				if (size > 0)
+				{
+					const vk::BufferCopy bufferCopy({}, {}, size);
+					commandBuffer.copyBuffer(bufferHandle_, destination->GetHandle(), bufferCopy);
+				}
+			});
+		});
+		transfers.KeepAlive(shared_from_this());
+		return handle;
 	}
 
-	void CopyTo(vk::UniqueImage& destination, const vk::Extent3D imageExtent) const
+	TransferManager::Handle CopyTo(vk::UniqueImage& destination, const vk::Extent3D imageExtent) const
 	{
 		DebugMessage("Buffer::CopyTo(\"" + debugName_ + "\", vk::Image)");
 		// TODO: [zpuls 2020-07-31T17:41] Add error-handling for image destinations that don't have the correct size (whatever that means in the context of vk::BufferImageCopy).
-		auto commandBuffers = deviceContext_.LogicalDevice->allocateCommandBuffersUnique({ commandPool_.get(), {}, 1 });
-		auto& commandBuffer = commandBuffers[0];
-		commandBuffer->begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-
-		vk::BufferImageCopy bufferImageCopy({}, {}, {}, {vk::ImageAspectFlagBits::eColor, {}, {}, 1}, {0, 0, 0},
-		                                    imageExtent);
-		commandBuffer->copyBufferToImage(bufferHandle_, destination.get(), vk::ImageLayout::eTransferDstOptimal,
-		                                 bufferImageCopy);
-		
-		commandBuffer->end();
-		vk::SubmitInfo submitInfo({}, {}, {}, 1, &commandBuffer.get());
-		deviceContext_.GraphicsQueue->submit(1, &submitInfo, nullptr);
-		deviceContext_.GraphicsQueue->waitIdle();
+		auto& transfers = *deviceContext_.Transfers;
+		const auto handle = transfers.Record([this, &destination, imageExtent](const vk::CommandBuffer commandBuffer)
+		{
+			const vk::BufferImageCopy bufferImageCopy({}, {}, {}, {vk::ImageAspectFlagBits::eColor, {}, {}, 1},
+			                                          {0, 0, 0}, imageExtent);
+			commandBuffer.copyBufferToImage(bufferHandle_, destination.get(), vk::ImageLayout::eTransferDstOptimal,
+			                                bufferImageCopy);
+		});
+		transfers.KeepAlive(shared_from_this());
+		return handle;
+	}
+
+	// Wraps record, which records Transfer commands writing [offset, offset + size) of this buffer and returns their
+	// TransferManager::Handle, in the queue family ownership transfers they need. The first write hands the range over
+	// to the graphics queue family. Later writes, e.g. re-uploads of rewritten buffers, first reclaim it for the transfer
+	// family, so the copy is never made by a family that doesn't own the buffer.
+	template <typename RecordFunction>
+	TransferManager::Handle RecordWrite(const vk::DeviceSize offset, const vk::DeviceSize size, RecordFunction&& record)
+	{
+		if (size == 0)
+		{
+			return record();
+		}
+
+		auto& transfers = *deviceContext_.Transfers;
+		if (ownedByGraphics_)
+		{
+			transfers.ReclaimOwnership(bufferHandle_, offset, size);
+		}
+
+		const auto handle = record();
+		transfers.TransferOwnership(bufferHandle_, offset, size);
+		ownedByGraphics_ = true;
+		return handle;
 	}
 
 	const vk::Buffer& GetHandle() const
@@ -118,19 +184,21 @@ protected:
 	vk::MemoryPropertyFlags memoryFlags_;
 	std::string debugName_ = "";
 	vk::Buffer bufferHandle_;
-	vk::DeviceMemory memoryHandle_;
+	MemoryAllocator::Allocation allocation_;
+	void* mappedData_ = nullptr;
+	// Set by the first RecordWrite(), after which the graphics queue family owns the buffer between writes.
+	bool ownedByGraphics_ = false;
 
-	void* map_(const vk::DeviceSize size, const void* data, const vk::DeviceSize offset = 0,
-	           const vk::MemoryMapFlags flags = vk::MemoryMapFlags()) const
+	void* map_() const
 	{
 		DebugMessage("Buffer::map_(\"" + debugName_ + "\")");
-		return deviceContext_.LogicalDevice->mapMemory(memoryHandle_, offset, size, flags);
+		return deviceContext_.Allocator->Map(allocation_);
 	}
 
 	void unmap_() const
 	{
 		DebugMessage("Buffer::unmap_(\"" + debugName_ + "\")");
-		deviceContext_.LogicalDevice->unmapMemory(memoryHandle_);
+		deviceContext_.Allocator->Unmap(allocation_);
 	}
 };
 
@@ -179,6 +247,151 @@ public:
 	}
 };
 
+class InstanceBuffer : public Buffer
+{
+public:
+	InstanceBuffer(const VulkanDeviceContext& deviceContext, vk::UniqueCommandPool& commandPool,
+		const vk::DeviceSize size, const vk::BufferUsageFlags& usageFlags, const vk::SharingMode sharingMode,
+		const vk::MemoryPropertyFlags& memoryFlags, const std::string& debugName)
+		: Buffer(deviceContext, commandPool, size, usageFlags, sharingMode, memoryFlags, debugName)
+	{
+	}
+
+	// Per-instance data is always read from binding 1, binding 0 holds the per-vertex data of the instanced mesh.
+	void Bind(vk::UniqueCommandBuffer& commandBuffer)
+	{
+		DebugMessage("InstanceBuffer::Bind(\"" + debugName_ + "\")");
+		commandBuffer->bindVertexBuffers(1, bufferHandle_, static_cast<vk::DeviceSize>(0));
+	}
+};
+
+// A host-visible vertex buffer split into one slice per frame in flight, for data that is rewritten every frame. The CPU
+// writes the slice of the frame it is recording while the GPU still reads the slices of earlier frames. Each slice
+// remembers the fence of the last submission that read it, and Acquire() waits on that fence before handing the slice
+// out again, so a slice is never overwritten while it is in use.
+class DynamicVertexBuffer : public Buffer
+{
+public:
+	DynamicVertexBuffer(const VulkanDeviceContext& deviceContext, vk::UniqueCommandPool& commandPool,
+		const vk::DeviceSize sliceSize, const uint32_t numSlices, const std::string& debugName)
+		: Buffer(deviceContext, commandPool, alignSliceSize_(sliceSize) * numSlices,
+		         vk::BufferUsageFlagBits::eVertexBuffer, vk::SharingMode::eExclusive,
+		         vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, debugName),
+		  sliceSize_(alignSliceSize_(sliceSize)), sliceFences_(numSlices)
+	{
+	}
+
+	// Returns the mapped memory of the given slice, once the GPU is done reading it.
+	void* Acquire(const uint32_t slice)
+	{
+		auto& fence = sliceFences_[slice];
+		if (fence)
+		{
+			const auto result = deviceContext_.LogicalDevice->waitForFences(fence, VK_TRUE, UINT64_MAX);
+			if (result != vk::Result::eSuccess)
+			{
+				throw std::runtime_error("Could not wait for vk::Fence guarding slice [" + std::to_string(slice) +
+					"] of DynamicVertexBuffer \"" + debugName_ + "\".");
+			}
+			fence = nullptr;
+		}
+
+		return static_cast<char*>(GetMappedData()) + GetOffset(slice);
+	}
+
+	// Marks the slice as in use, until the given fence (signaled by the submission that reads it) is signaled.
+	void Release(const uint32_t slice, const vk::Fence fence)
+	{
+		sliceFences_[slice] = fence;
+	}
+
+	void Bind(vk::UniqueCommandBuffer& commandBuffer, const uint32_t binding, const uint32_t slice) const
+	{
+		DebugMessage("DynamicVertexBuffer::Bind(\"" + debugName_ + "\")");
+		commandBuffer->bindVertexBuffers(binding, bufferHandle_, GetOffset(slice));
+	}
+
+	[[nodiscard]] vk::DeviceSize GetOffset(const uint32_t slice) const
+	{
+		return sliceSize_ * slice;
+	}
+
+private:
+	vk::DeviceSize sliceSize_;
+	std::vector<vk::Fence> sliceFences_;
+
+	// Keeps every slice on its own 256-byte boundary, which satisfies any nonCoherentAtomSize and vertex attribute
+	// alignment, should the buffer ever need to be flushed per slice.
+	static vk::DeviceSize alignSliceSize_(const vk::DeviceSize sliceSize)
+	{
+		return (sliceSize + SLICE_ALIGNMENT - 1) / SLICE_ALIGNMENT * SLICE_ALIGNMENT;
+	}
+
+	static const inline vk::DeviceSize SLICE_ALIGNMENT = 256;
+};
+
+// A host-visible uniform buffer split into one slice per frame in flight, that uniform data is appended to linearly.
+// Descriptors point at the start of the buffer as eUniformBufferDynamic, and draws bind the offset Push() returned, so
+// every draw of every frame shares one buffer. A slice is reset once its frame's fence has been waited on.
+class DynamicUniformBuffer : public Buffer
+{
+public:
+	DynamicUniformBuffer(const VulkanDeviceContext& deviceContext, vk::UniqueCommandPool& commandPool,
+		const vk::DeviceSize sliceSize, const uint32_t numSlices, const std::string& debugName)
+		: Buffer(deviceContext, commandPool,
+		         alignUp_(sliceSize, getOffsetAlignment_(deviceContext)) * numSlices,
+		         vk::BufferUsageFlagBits::eUniformBuffer, vk::SharingMode::eExclusive,
+		         vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, debugName),
+		  offsetAlignment_(getOffsetAlignment_(deviceContext)),
+		  sliceSize_(alignUp_(sliceSize, offsetAlignment_)), sliceCursors_(numSlices, 0)
+	{
+	}
+
+	void Reset(const uint32_t slice)
+	{
+		sliceCursors_[slice] = 0;
+	}
+
+	// Appends size bytes of data to the given slice. Returns the dynamic offset to bind the data with.
+	uint32_t Push(const uint32_t slice, const void* data, const vk::DeviceSize size)
+	{
+		auto& cursor = sliceCursors_[slice];
+		if (cursor + size > sliceSize_)
+		{
+			throw std::runtime_error("Could not push [" + std::to_string(size) + "] bytes to slice [" +
+				std::to_string(slice) + "] of DynamicUniformBuffer \"" + debugName_ + "\", its capacity of [" +
+				std::to_string(sliceSize_) + "] bytes per frame has been reached.");
+		}
+
+		const auto offset = sliceSize_ * slice + cursor;
+		Fill(offset, size, data);
+		cursor = alignUp_(cursor + size, offsetAlignment_);
+		return static_cast<uint32_t>(offset);
+	}
+
+	// range is the size of the data each draw reads, which is the same for every draw that uses the descriptor.
+	vk::DescriptorBufferInfo GenerateDescriptorBufferInfo(const vk::DeviceSize range) const
+	{
+		return {bufferHandle_, 0, range};
+	}
+
+private:
+	vk::DeviceSize offsetAlignment_;
+	vk::DeviceSize sliceSize_;
+	std::vector<vk::DeviceSize> sliceCursors_;
+
+	static vk::DeviceSize getOffsetAlignment_(const VulkanDeviceContext& deviceContext)
+	{
+		return std::max<vk::DeviceSize>(
+			deviceContext.PhysicalDevice->getProperties().limits.minUniformBufferOffsetAlignment, 1);
+	}
+
+	static vk::DeviceSize alignUp_(const vk::DeviceSize value, const vk::DeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+};
+
 class PixelBuffer : public Buffer
 {
 public:
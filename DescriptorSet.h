@@ -36,10 +36,24 @@ public:
 		}
 	}
 
-	void Bind(const uint32_t frameIndex, vk::UniquePipelineLayout& pipelineLayout, vk::UniqueCommandBuffer& commandBuffer)
+	// Updates only the vk::DescriptorSet of the given frame, for resources that exist once per frame in flight.
+	void Update(const uint32_t frameIndex, std::vector<vk::WriteDescriptorSet>& descriptorWrites)
+	{
+		DebugMessage("DescriptorSet::Update(" + std::to_string(frameIndex) + ")");
+		for (auto& descriptorWrite : descriptorWrites)
+		{
+			descriptorWrite.dstSet = DescriptorSets[frameIndex].get();
+		}
+		deviceContext_.LogicalDevice->updateDescriptorSets(descriptorWrites, nullptr);
+	}
+
+	// dynamicOffsets holds one offset per eUniformBufferDynamic binding of the layout, in binding order.
+	void Bind(const uint32_t frameIndex, vk::UniquePipelineLayout& pipelineLayout, vk::UniqueCommandBuffer& commandBuffer,
+	          const vk::PipelineBindPoint pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
+	          const vk::ArrayProxy<const uint32_t>& dynamicOffsets = nullptr)
 	{
 		DebugMessage("DescriptorSet::Bind()");
-		commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout.get(), 0, 1, &(*DescriptorSets[frameIndex]), 0, nullptr);
+		commandBuffer->bindDescriptorSets(pipelineBindPoint, pipelineLayout.get(), 0, DescriptorSets[frameIndex].get(), dynamicOffsets);
 	}
 
 private:
@@ -2,6 +2,8 @@
 
 #include "stdafx.h"
 #include "VulkanDeviceContext.h"
+#include "MemoryAllocator.h"
+#include "TransferManager.h"
 #include "Util.h"
 
 class Image
@@ -24,17 +26,17 @@ public:
 		});
 		
 		const auto memoryRequirements = deviceContext_.LogicalDevice->getImageMemoryRequirements(imageHandle_.get());
-		memoryHandle_ = deviceContext_.LogicalDevice->allocateMemoryUnique({
-			memoryRequirements.size,
-			Util::FindSupportedMemoryType(
-				deviceContext_, memoryRequirements.memoryTypeBits, memoryPropertyFlags)
-		});
-		deviceContext_.LogicalDevice->bindImageMemory(imageHandle_.get(), memoryHandle_.get(), 0);
+		allocation_ = deviceContext_.Allocator->Allocate(memoryRequirements, memoryPropertyFlags,
+		                                                 MemoryAllocator::ResourceType::Optimal);
+		deviceContext_.LogicalDevice->bindImageMemory(imageHandle_.get(), allocation_.Memory, allocation_.Offset);
 	}
 
 	~Image()
 	{
 		DebugMessage("Image::~Image()");
+		imageView_.reset();
+		imageHandle_.reset();
+		deviceContext_.Allocator->Free(allocation_);
 	}
 
 	void CreateImageView(vk::Format format, vk::ImageAspectFlags aspectFlags)
@@ -48,19 +50,17 @@ public:
 	void TransitionLayout(vk::Format format,
 	                      vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::AccessFlags sourceAccessMask,
 	                      vk::AccessFlags destinationAccessMask, vk::PipelineStageFlags sourceStage,
-	                      vk::PipelineStageFlags destinationStage, vk::ImageAspectFlags aspectFlags)
+	                      vk::PipelineStageFlags destinationStage, vk::ImageAspectFlags aspectFlags,
+	                      const TransferManager::Queue queue = TransferManager::Queue::Graphics)
 	{
-		auto commandBuffers = deviceContext_.LogicalDevice->allocateCommandBuffersUnique({ commandPool_.get(), {}, 1 });
-		auto& commandBuffer = commandBuffers[0];
-		commandBuffer->begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-		commandBuffer->pipelineBarrier(sourceStage, destinationStage, {}, {}, {}, vk::ImageMemoryBarrier{
-			                               sourceAccessMask, destinationAccessMask, oldLayout, newLayout, {}, {},
-			                               imageHandle_.get(), {aspectFlags, 0, mipLevels_, 0, 1}
-		                               });
-		commandBuffer->end();
-		vk::SubmitInfo submitInfo({}, {}, {}, 1, &commandBuffer.get());
-		deviceContext_.GraphicsQueue->submit(1, &submitInfo, nullptr);
-		deviceContext_.GraphicsQueue->waitIdle();
+		deviceContext_.Transfers->Record([&](const vk::CommandBuffer commandBuffer)
+		{
+			commandBuffer.pipelineBarrier(sourceStage, destinationStage, {}, {}, {}, vk::ImageMemoryBarrier{
+				                              sourceAccessMask, destinationAccessMask, oldLayout, newLayout,
+				                              VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+				                              imageHandle_.get(), {aspectFlags, 0, mipLevels_, 0, 1}
+			                              });
+		}, queue);
 	}
 
 	vk::UniqueImageView& GetImageView()
@@ -72,7 +72,7 @@ protected:
 	const VulkanDeviceContext deviceContext_;
 	vk::UniqueCommandPool& commandPool_;
 	vk::UniqueImage imageHandle_;
-	vk::UniqueDeviceMemory memoryHandle_;
+	MemoryAllocator::Allocation allocation_;
 	vk::UniqueImageView imageView_;
 
 	uint32_t width_;
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "stdafx.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Fixed-size worker pool with one job deque per thread. Each thread pushes and pops its own deque from the back, and
+// steals from the front of the other deques when its own runs dry. Threads that are not workers (e.g. the render
+// thread) share slot 0, and help execute jobs while they JobSystem::Wait() on a counter, so jobs may safely spawn and
+// wait on nested jobs.
+class JobSystem
+{
+public:
+	using Job = std::function<void()>;
+
+	// Tracks the number of outstanding jobs in a group, JobSystem::Wait() returns once it reaches zero. The first
+	// exception thrown by any of the group's jobs is kept, and rethrown by JobSystem::Wait().
+	class Counter
+	{
+	public:
+		[[nodiscard]] bool IsDone() const
+		{
+			return pending_.load(std::memory_order_acquire) == 0;
+		}
+
+	private:
+		friend class JobSystem;
+		std::atomic<uint32_t> pending_ = 0;
+		std::mutex exceptionMutex_;
+		std::exception_ptr exception_;
+
+		void fail_(std::exception_ptr exception)
+		{
+			std::lock_guard<std::mutex> lock(exceptionMutex_);
+			if (exception_ == nullptr)
+			{
+				exception_ = std::move(exception);
+			}
+		}
+	};
+
+	explicit JobSystem(const uint32_t numWorkers = defaultNumWorkers_())
+	{
+		DebugMessage("JobSystem::JobSystem(numWorkers=" + std::to_string(numWorkers) + ")");
+		for (uint32_t i = 0; i < numWorkers + 1; ++i)
+		{
+			queues_.emplace_back(std::make_unique<WorkQueue>());
+		}
+
+		for (uint32_t i = 1; i < numWorkers + 1; ++i)
+		{
+			workers_.emplace_back(&JobSystem::workerLoop_, this, i);
+		}
+	}
+
+	~JobSystem()
+	{
+		DebugMessage("JobSystem::~JobSystem()");
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex_);
+			stopping_ = true;
+		}
+		wakeCondition_.notify_all();
+
+		for (auto& worker : workers_)
+		{
+			worker.join();
+		}
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	void Submit(Job job, Counter& counter)
+	{
+		counter.pending_.fetch_add(1, std::memory_order_relaxed);
+		{
+			auto& queue = *queues_[currentQueueIndex_()];
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			queue.Jobs.emplace_back([job = std::move(job), &counter]
+			{
+				// The counter is only released once the job is done with it, whether it returned or threw. An exception
+				// is handed to Wait() instead of escaping the worker thread, which would terminate the process.
+				struct Release
+				{
+					Counter& Jobs;
+
+					~Release()
+					{
+						Jobs.pending_.fetch_sub(1, std::memory_order_acq_rel);
+					}
+				} release{counter};
+
+				try
+				{
+					job();
+				}
+				catch (...)
+				{
+					counter.fail_(std::current_exception());
+				}
+			});
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex_);
+			++queuedJobs_;
+		}
+		wakeCondition_.notify_one();
+	}
+
+	// Splits [begin, end) into chunks of at most chunkSize elements, and submits one job per chunk. Throws
+	// std::invalid_argument if chunkSize is 0.
+	void ParallelFor(const uint32_t begin, const uint32_t end, const uint32_t chunkSize,
+	                 const std::function<void(uint32_t, uint32_t)>& body, Counter& counter)
+	{
+		if (chunkSize == 0)
+		{
+			throw std::invalid_argument("Could not split [" + std::to_string(begin) + ", " + std::to_string(end) +
+				") into chunks of 0 elements.");
+		}
+
+		for (auto chunkBegin = begin; chunkBegin < end; chunkBegin += std::min(chunkSize, end - chunkBegin))
+		{
+			const auto chunkEnd = chunkBegin + std::min(chunkSize, end - chunkBegin);
+			Submit([body, chunkBegin, chunkEnd] { body(chunkBegin, chunkEnd); }, counter);
+		}
+	}
+
+	// Runs queued jobs on the calling thread until every job tracked by counter has finished, then rethrows the first
+	// exception any of them threw. No job references counter anymore by then, so it can safely go out of scope.
+	void Wait(Counter& counter)
+	{
+		const auto queueIndex = currentQueueIndex_();
+		while (!counter.IsDone())
+		{
+			if (!tryRunJob_(queueIndex))
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		std::exception_ptr exception;
+		{
+			std::lock_guard<std::mutex> lock(counter.exceptionMutex_);
+			std::swap(exception, counter.exception_);
+		}
+
+		if (exception != nullptr)
+		{
+			std::rethrow_exception(exception);
+		}
+	}
+
+	[[nodiscard]] uint32_t GetNumWorkers() const
+	{
+		return static_cast<uint32_t>(workers_.size());
+	}
+
+	// Index of the calling thread in [0, GetNumWorkers()], for per-thread resources. Threads that are not workers get 0.
+	[[nodiscard]] uint32_t GetCurrentThreadIndex() const
+	{
+		return currentQueueIndex_();
+	}
+
+private:
+	struct WorkQueue
+	{
+		std::mutex Mutex;
+		std::deque<Job> Jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> queues_;
+	std::vector<std::thread> workers_;
+	std::mutex wakeMutex_;
+	std::condition_variable wakeCondition_;
+	size_t queuedJobs_ = 0;
+	bool stopping_ = false;
+
+	inline static thread_local const JobSystem* currentJobSystem_ = nullptr;
+	inline static thread_local uint32_t currentWorkerIndex_ = 0;
+
+	static uint32_t defaultNumWorkers_()
+	{
+		const auto hardwareThreads = std::thread::hardware_concurrency();
+		return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	uint32_t currentQueueIndex_() const
+	{
+		return currentJobSystem_ == this ? currentWorkerIndex_ : 0;
+	}
+
+	bool tryPop_(const uint32_t queueIndex, Job& job)
+	{
+		auto& queue = *queues_[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if (queue.Jobs.empty())
+		{
+			return false;
+		}
+
+		job = std::move(queue.Jobs.back());
+		queue.Jobs.pop_back();
+		return true;
+	}
+
+	bool trySteal_(const uint32_t queueIndex, Job& job)
+	{
+		auto& queue = *queues_[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if (queue.Jobs.empty())
+		{
+			return false;
+		}
+
+		job = std::move(queue.Jobs.front());
+		queue.Jobs.pop_front();
+		return true;
+	}
+
+	bool tryRunJob_(const uint32_t queueIndex)
+	{
+		Job job;
+		auto found = tryPop_(queueIndex, job);
+		for (uint32_t i = 1; !found && i < queues_.size(); ++i)
+		{
+			found = trySteal_(static_cast<uint32_t>((queueIndex + i) % queues_.size()), job);
+		}
+
+		if (!found)
+		{
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex_);
+			--queuedJobs_;
+		}
+		job();
+		return true;
+	}
+
+	void workerLoop_(const uint32_t workerIndex)
+	{
+		currentJobSystem_ = this;
+		currentWorkerIndex_ = workerIndex;
+
+		while (true)
+		{
+			if (tryRunJob_(workerIndex))
+			{
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(wakeMutex_);
+			wakeCondition_.wait(lock, [this] { return stopping_ || queuedJobs_ > 0; });
+			if (stopping_)
+			{
+				return;
+			}
+		}
+	}
+};
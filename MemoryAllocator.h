@@ -0,0 +1,299 @@
+#pragma once
+
+#include "stdafx.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Sub-allocates buffer and image memory out of large vk::DeviceMemory blocks, instead of giving every resource its own
+// vk::Device::allocateMemory() call, which is slow and limited to maxMemoryAllocationCount allocations per device.
+//
+// Blocks are grouped per memory type, and each block hands out ranges from a first-fit free list that coalesces on free.
+// When the device's bufferImageGranularity is larger than 1, buffers and optimal-tiling images are kept in separate
+// blocks, so linear and non-linear resources never end up on the same granularity page.
+class MemoryAllocator
+{
+	struct Block;
+
+public:
+	enum class ResourceType
+	{
+		Linear,
+		Optimal,
+		Count
+	};
+
+	struct Allocation
+	{
+		vk::DeviceMemory Memory;
+		vk::DeviceSize Offset = 0;
+		vk::DeviceSize Size = 0;
+		Block* Owner = nullptr;
+	};
+
+	MemoryAllocator(const std::shared_ptr<vk::PhysicalDevice>& physicalDevice,
+	                const std::shared_ptr<vk::Device>& logicalDevice,
+	                const vk::DeviceSize blockSize = DEFAULT_BLOCK_SIZE) : logicalDevice_(logicalDevice),
+	                                                                       memoryProperties_(
+		                                                                       physicalDevice->getMemoryProperties()),
+	                                                                       bufferImageGranularity_(
+		                                                                       physicalDevice->getProperties().limits.
+		                                                                       bufferImageGranularity),
+	                                                                       nonCoherentAtomSize_(
+		                                                                       physicalDevice->getProperties().limits.
+		                                                                       nonCoherentAtomSize),
+	                                                                       blockSize_(blockSize)
+	{
+		DebugMessage("MemoryAllocator::MemoryAllocator(blockSize=" + std::to_string(blockSize_) + ")");
+		pools_.resize(static_cast<size_t>(memoryProperties_.memoryTypeCount) * static_cast<size_t>(ResourceType::Count));
+	}
+
+	~MemoryAllocator()
+	{
+		DebugMessage("MemoryAllocator::~MemoryAllocator()");
+		for (auto& pool : pools_)
+		{
+			for (auto& block : pool)
+			{
+				freeBlock_(*block);
+			}
+		}
+	}
+
+	MemoryAllocator(const MemoryAllocator&) = delete;
+	MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+	Allocation Allocate(const vk::MemoryRequirements& memoryRequirements, const vk::MemoryPropertyFlags properties,
+	                    const ResourceType resourceType)
+	{
+		const auto memoryTypeIndex = findMemoryType_(memoryRequirements.memoryTypeBits, properties);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& pool = pools_[poolIndex_(memoryTypeIndex, resourceType)];
+		for (auto& block : pool)
+		{
+			if (!block->Dedicated)
+			{
+				Allocation allocation;
+				if (allocateFromBlock_(*block, memoryRequirements, allocation))
+				{
+					return allocation;
+				}
+			}
+		}
+
+		// Requests that would take up most of a block get a block of their own, which is freed with them.
+		const auto dedicated = memoryRequirements.size > blockSize_ / 2;
+		auto& block = allocateBlock_(pool, memoryTypeIndex, dedicated ? memoryRequirements.size : blockSize_,
+		                             dedicated);
+		Allocation allocation;
+		if (!allocateFromBlock_(block, memoryRequirements, allocation))
+		{
+			throw std::runtime_error("Could not sub-allocate [" + std::to_string(memoryRequirements.size) +
+				"] bytes from a new vk::DeviceMemory block of [" + std::to_string(block.Size) + "] bytes.");
+		}
+		return allocation;
+	}
+
+	void Free(Allocation& allocation)
+	{
+		if (allocation.Owner == nullptr)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& block = *allocation.Owner;
+		insertFreeRange_(block, allocation.Owner->RangeOffsets.at(allocation.Offset), allocation.Offset + allocation.Size);
+		block.RangeOffsets.erase(allocation.Offset);
+		allocation = {};
+
+		// Keep one empty block per pool around, so a resource that is recreated every frame doesn't allocate every frame.
+		auto& pool = pools_[block.PoolIndex];
+		if (block.RangeOffsets.empty() && (block.Dedicated || pool.size() > 1))
+		{
+			freeBlock_(block);
+			pool.erase(std::find_if(pool.begin(), pool.end(), [&block](const auto& candidate)
+			{
+				return candidate.get() == &block;
+			}));
+		}
+	}
+
+	// Blocks are mapped whole, and stay mapped while any of their allocations is, since a vk::DeviceMemory can only be
+	// mapped once at a time. Only valid for eHostVisible memory.
+	void* Map(const Allocation& allocation)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& block = *allocation.Owner;
+		if (block.MapCount++ == 0)
+		{
+			block.MappedData = logicalDevice_->mapMemory(block.Memory, 0, VK_WHOLE_SIZE);
+		}
+
+		return static_cast<char*>(block.MappedData) + allocation.Offset;
+	}
+
+	void Unmap(const Allocation& allocation)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& block = *allocation.Owner;
+		if (--block.MapCount == 0)
+		{
+			logicalDevice_->unmapMemory(block.Memory);
+			block.MappedData = nullptr;
+		}
+	}
+
+	// Makes host writes to [offset, offset + size) of a mapped allocation visible to the device. A no-op for eHostCoherent
+	// memory. The range is widened to nonCoherentAtomSize, which is safe because the whole block is mapped.
+	void Flush(const Allocation& allocation, const vk::DeviceSize offset, const vk::DeviceSize size) const
+	{
+		const auto& block = *allocation.Owner;
+		if (GetMemoryType(allocation).propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent)
+		{
+			return;
+		}
+
+		const auto begin = (allocation.Offset + offset) / nonCoherentAtomSize_ * nonCoherentAtomSize_;
+		const auto end = (allocation.Offset + offset + size + nonCoherentAtomSize_ - 1) / nonCoherentAtomSize_ *
+			nonCoherentAtomSize_;
+		logicalDevice_->flushMappedMemoryRanges(vk::MappedMemoryRange(block.Memory, begin,
+		                                                              end >= block.Size ? VK_WHOLE_SIZE : end - begin));
+	}
+
+	[[nodiscard]] const vk::MemoryType& GetMemoryType(const Allocation& allocation) const
+	{
+		return memoryProperties_.memoryTypes[allocation.Owner->MemoryTypeIndex];
+	}
+
+	static const inline vk::DeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+private:
+	struct Block
+	{
+		vk::DeviceMemory Memory;
+		vk::DeviceSize Size = 0;
+		uint32_t MemoryTypeIndex = 0;
+		size_t PoolIndex = 0;
+		bool Dedicated = false;
+		// Free ranges, keyed by offset, mapped to their end.
+		std::map<vk::DeviceSize, vk::DeviceSize> FreeRanges;
+		// Live allocations, keyed by their aligned offset, mapped to the start of the range they took, which includes
+		// any alignment padding in front of them.
+		std::map<vk::DeviceSize, vk::DeviceSize> RangeOffsets;
+		uint32_t MapCount = 0;
+		void* MappedData = nullptr;
+	};
+
+	std::shared_ptr<vk::Device> logicalDevice_;
+	vk::PhysicalDeviceMemoryProperties memoryProperties_;
+	vk::DeviceSize bufferImageGranularity_;
+	vk::DeviceSize nonCoherentAtomSize_;
+	vk::DeviceSize blockSize_;
+	std::mutex mutex_;
+	std::vector<std::vector<std::unique_ptr<Block>>> pools_;
+
+	size_t poolIndex_(const uint32_t memoryTypeIndex, const ResourceType resourceType) const
+	{
+		const auto type = bufferImageGranularity_ > 1 ? static_cast<size_t>(resourceType) : 0;
+		return static_cast<size_t>(memoryTypeIndex) * static_cast<size_t>(ResourceType::Count) + type;
+	}
+
+	uint32_t findMemoryType_(const uint32_t typeFilter, const vk::MemoryPropertyFlags properties) const
+	{
+		for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; i++)
+		{
+			if ((typeFilter & (1 << i)) && (memoryProperties_.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return i;
+			}
+		}
+
+		throw std::runtime_error(
+			"Could not find supported vk::MemoryType that matches given filter: type=" + std::to_string(typeFilter) +
+			", properties=" + std::to_string(static_cast<uint32_t>(properties)) + ".");
+	}
+
+	Block& allocateBlock_(std::vector<std::unique_ptr<Block>>& pool, const uint32_t memoryTypeIndex,
+	                      const vk::DeviceSize size, const bool dedicated)
+	{
+		DebugMessage("MemoryAllocator::allocateBlock_(memoryType=" + std::to_string(memoryTypeIndex) + ", size=" +
+			std::to_string(size) + ")");
+		auto block = std::make_unique<Block>();
+		WRAP_VK_MEMORY_EXCEPTIONS(block->Memory = logicalDevice_->allocateMemory({size, memoryTypeIndex}),
+		                          "MemoryAllocator::allocateBlock_() - vk::Device::allocateMemory()")
+		block->Size = size;
+		block->MemoryTypeIndex = memoryTypeIndex;
+		block->PoolIndex = static_cast<size_t>(&pool - pools_.data());
+		block->Dedicated = dedicated;
+		block->FreeRanges.emplace(0, size);
+		pool.emplace_back(std::move(block));
+		return *pool.back();
+	}
+
+	void freeBlock_(Block& block) const
+	{
+		DebugMessage("MemoryAllocator::freeBlock_(memoryType=" + std::to_string(block.MemoryTypeIndex) + ", size=" +
+			std::to_string(block.Size) + ")");
+		if (block.MappedData != nullptr)
+		{
+			logicalDevice_->unmapMemory(block.Memory);
+		}
+		logicalDevice_->freeMemory(block.Memory);
+	}
+
+	static bool allocateFromBlock_(Block& block, const vk::MemoryRequirements& memoryRequirements,
+	                               Allocation& allocation)
+	{
+		const auto alignment = std::max<vk::DeviceSize>(memoryRequirements.alignment, 1);
+		for (auto range = block.FreeRanges.begin(); range != block.FreeRanges.end(); ++range)
+		{
+			const auto [begin, end] = *range;
+			const auto offset = (begin + alignment - 1) / alignment * alignment;
+			if (offset + memoryRequirements.size > end)
+			{
+				continue;
+			}
+
+			block.FreeRanges.erase(range);
+			if (offset + memoryRequirements.size < end)
+			{
+				block.FreeRanges.emplace(offset + memoryRequirements.size, end);
+			}
+			block.RangeOffsets.emplace(offset, begin);
+
+			allocation.Memory = block.Memory;
+			allocation.Offset = offset;
+			allocation.Size = memoryRequirements.size;
+			allocation.Owner = &block;
+			return true;
+		}
+
+		return false;
+	}
+
+	static void insertFreeRange_(Block& block, vk::DeviceSize begin, vk::DeviceSize end)
+	{
+		const auto next = block.FreeRanges.lower_bound(begin);
+		if (next != block.FreeRanges.end() && next->first == end)
+		{
+			end = next->second;
+			block.FreeRanges.erase(next);
+		}
+
+		const auto previous = block.FreeRanges.lower_bound(begin);
+		if (previous != block.FreeRanges.begin() && std::prev(previous)->second == begin)
+		{
+			std::prev(previous)->second = end;
+			return;
+		}
+
+		block.FreeRanges.emplace(begin, end);
+	}
+};
@@ -2,16 +2,20 @@
 
 #include "Texture.h"
 #include "Buffer.h"
+#include "StagingRing.h"
 
 // TODO: Make this more intelligent. Add the ability to attach an arbitrary amount of render passes, shaders, effects, etc. to a mesh.
 class Mesh
 {
 public:
+	// uvRect selects the part of the texture the mesh's texture coordinates span, e.g. an image in a TextureAtlas, see
+	// TextureAtlas::GetUvRect().
 	Mesh(const VulkanDeviceContext deviceContext, vk::UniqueCommandPool& commandPool,
 	     const bool isIndexed, const uint32_t transformIndex, const uint32_t textureIndex,
-	     const uint32_t descriptorSetIndex) : deviceContext_(deviceContext), commandPool_(commandPool),
-	                                          isIndexed_(isIndexed), transformIndex_(transformIndex),
-	                                          textureIndex_(textureIndex), descriptorSetIndex_(descriptorSetIndex)
+	     const uint32_t descriptorSetIndex, const glm::vec4& uvRect = FULL_UV_RECT) : deviceContext_(deviceContext),
+	                                          commandPool_(commandPool), isIndexed_(isIndexed),
+	                                          transformIndex_(transformIndex), textureIndex_(textureIndex),
+	                                          descriptorSetIndex_(descriptorSetIndex), uvRect_(uvRect)
 	{
 		DebugMessage("Mesh::Mesh()");
 	}
@@ -21,16 +25,22 @@ public:
 		DebugMessage("Cleaning up VulkanParticles::Mesh.");
 	}
 
-	void Create(const std::vector<Vertex>& vertices, const std::vector<uint32_t> indices, const uint32_t maxFramesInFlight)
+	void Create(const std::vector<Vertex>& vertices, const std::vector<uint32_t> indices)
 	{
 		DebugMessage("Mesh::Create()");
+		auto& staging = *deviceContext_.Staging;
 		auto vertexBufferSize = vertices.size() * sizeof(vertices[0]);
-		auto vertexStagingBuffer = std::make_shared<VertexBuffer>(deviceContext_, commandPool_, vertexBufferSize,
-			vk::BufferUsageFlagBits::eTransferSrc,
-			vk::SharingMode::eExclusive,
-			vk::MemoryPropertyFlagBits::eHostVisible |
-			vk::MemoryPropertyFlagBits::eHostCoherent, "Mesh::vertexStagingBuffer");
-		vertexStagingBuffer->Fill(0, vertexBufferSize, &vertices[0]);
+		// Remapped once here, so the shaders don't need to know about atlases.
+		std::vector<Vertex> remappedVertices;
+		if (uvRect_ != FULL_UV_RECT)
+		{
+			remappedVertices.reserve(vertices.size());
+			for (const auto& vertex : vertices)
+			{
+				remappedVertices.emplace_back(vertex.Position, vertex.Color, RemapTexCoord(vertex.TexCoord));
+			}
+		}
+		const auto& uploadedVertices = remappedVertices.empty() ? vertices : remappedVertices;
 
 		vertexBuffer_ = std::make_shared<VertexBuffer>(deviceContext_, commandPool_,
 			vertexBufferSize,
@@ -39,48 +49,29 @@ public:
 			vk::SharingMode::eExclusive,
 			vk::MemoryPropertyFlagBits::eDeviceLocal, "Mesh::vertexBuffer_");
 
-		vertexStagingBuffer->CopyTo(vertexBuffer_);
+		staging.CopyTo(staging.Upload(&uploadedVertices[0], vertexBufferSize), vertexBuffer_);
 
 		if (isIndexed_)
 		{
 			auto indexBufferSize = indices.size() * sizeof(indices[0]);
-			auto indexStagingBuffer = std::make_shared<IndexBuffer>(deviceContext_, commandPool_, indexBufferSize,
-				vk::BufferUsageFlagBits::eTransferSrc,
-				vk::SharingMode::eExclusive,
-				vk::MemoryPropertyFlagBits::eHostVisible |
-				vk::MemoryPropertyFlagBits::eHostCoherent, "Mesh::indexStagingBuffer");
-
-			indexStagingBuffer->Fill(0, indexBufferSize, &indices[0]);
-
 			indexBuffer_ = std::make_shared<IndexBuffer>(deviceContext_, commandPool_, indexBufferSize,
 				vk::BufferUsageFlagBits::eTransferDst |
 				vk::BufferUsageFlagBits::eIndexBuffer,
 				vk::SharingMode::eExclusive,
 				vk::MemoryPropertyFlagBits::eDeviceLocal, "Mesh::indexBuffer_");
 
-			indexStagingBuffer->CopyTo(indexBuffer_);
+			staging.CopyTo(staging.Upload(&indices[0], indexBufferSize), indexBuffer_);
 		}
 		else
 		{
 			indexBuffer_ = nullptr;
 		}
 
-		// TODO: [zpuls 2020-08-04T17:49] Handle Uniform Buffer creation better, allow for dynamic uniform binding based on bound shader.
-		uniformBuffers_ = std::vector<std::shared_ptr<GenericBuffer>>(maxFramesInFlight,
-		                                                              std::make_shared<GenericBuffer>(
-			                                                              deviceContext_, commandPool_,
-			                                                              sizeof(glm::mat4) * 3,
-			                                                              vk::BufferUsageFlagBits::eUniformBuffer,
-			                                                              vk::SharingMode::eExclusive,
-			                                                              vk::MemoryPropertyFlagBits::eHostVisible |
-			                                                              vk::MemoryPropertyFlagBits::eHostCoherent,
-			                                                              "Mesh::uniformBuffers_"));
-
 		// TODO: [zpuls 2020-08-02T22:02] Create DescriptorSetLayout/DescriptorSets based on the Mesh-bound shaders active at runtime.	
 	}
 
 	// TODO: [zpuls 2020-08-02T21:56] Allow for multiple vk::DescriptorSet bindings per-mesh.
-	void BindMeshData(const uint32_t frameIndex, vk::UniqueCommandBuffer& commandBuffer, std::array<glm::mat4, 3> mvp) const
+	void BindMeshData(const uint32_t frameIndex, vk::UniqueCommandBuffer& commandBuffer) const
 	{
 		DebugMessage("Mesh::BindMeshData()");
 		vertexBuffer_->Bind(commandBuffer);
@@ -88,7 +79,6 @@ public:
 		{
 			indexBuffer_->Bind(commandBuffer);
 		}
-		uniformBuffers_[frameIndex]->Fill(0, sizeof(mvp), &mvp[0]);
 	}
 
 	void Draw(vk::UniqueCommandBuffer& commandBuffer) const
@@ -124,19 +114,28 @@ public:
 		return descriptorSetIndex_;
 	}
 
-	[[nodiscard]] const std::shared_ptr<GenericBuffer>& GetUniformBuffer(const uint32_t index) const
+	[[nodiscard]] const glm::vec4& GetUvRect() const
 	{
-		return uniformBuffers_[index];
+		return uvRect_;
 	}
 
+	// Maps a texture coordinate in [0, 1] into the mesh's UV rect.
+	[[nodiscard]] glm::vec2 RemapTexCoord(const glm::vec2& texCoord) const
+	{
+		return glm::vec2(uvRect_.x, uvRect_.y) + texCoord * glm::vec2(uvRect_.z, uvRect_.w);
+	}
+
+	// Offset in xy, size in zw, covering the whole texture.
+	static const inline glm::vec4 FULL_UV_RECT = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+
 protected:
 	VulkanDeviceContext deviceContext_;
 	vk::UniqueCommandPool& commandPool_;
 	std::shared_ptr<VertexBuffer> vertexBuffer_;
 	bool isIndexed_;
 	std::shared_ptr<IndexBuffer> indexBuffer_;
-	std::vector<std::shared_ptr<GenericBuffer>> uniformBuffers_;
 	uint32_t textureIndex_;
 	uint32_t transformIndex_;
 	uint32_t descriptorSetIndex_;
+	glm::vec4 uvRect_;
 };
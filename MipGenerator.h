@@ -0,0 +1,265 @@
+#pragma once
+
+#include "stdafx.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define MIP_GENERATOR_SSE
+#include <xmmintrin.h>
+#endif
+
+// Builds RGBA8 mip chains on the CPU, for TextureCooker and for devices that can't blit the texture's format. Touches
+// no Vulkan state, so its output can be checked against reference images without a GPU.
+//
+// Each level is filtered from the previous one in linear space (color channels are decoded from sRGB first, unless told
+// otherwise), with a separable kernel, one RGBA texel per SSE register. Rows are split across JobSystem jobs.
+class MipGenerator
+{
+public:
+	enum class Filter
+	{
+		// 2x2 average, what a linear blit does.
+		Box,
+		// Windowed sinc over 6x6 texels, sharper, with little ringing.
+		Kaiser
+	};
+
+	struct Level
+	{
+		std::vector<unsigned char> Pixels;
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+	};
+
+	// Returns mipLevels levels, the first being a copy of pixels. Each level halves the previous one, rounding down, like
+	// vk::ImageCreateInfo expects. Without a jobSystem, everything runs on the calling thread.
+	static std::vector<Level> Generate(const unsigned char* pixels, const uint32_t width, const uint32_t height,
+	                                   const uint32_t mipLevels, const Filter filter = Filter::Kaiser,
+	                                   const bool srgb = true, JobSystem* jobSystem = nullptr)
+	{
+		std::vector<Level> levels(1);
+		levels[0].Pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+		levels[0].Width = width;
+		levels[0].Height = height;
+		for (uint32_t i = 1; i < mipLevels; ++i)
+		{
+			levels.emplace_back(Downsample(levels.back(), filter, srgb, jobSystem));
+		}
+		return levels;
+	}
+
+	static Level Downsample(const Level& source, const Filter filter, const bool srgb, JobSystem* jobSystem = nullptr)
+	{
+		Level level;
+		level.Width = std::max(source.Width / 2, 1U);
+		level.Height = std::max(source.Height / 2, 1U);
+		level.Pixels.resize(static_cast<size_t>(level.Width) * level.Height * 4);
+
+		const auto& kernel = filter == Filter::Box ? BOX_KERNEL : kaiserKernel_();
+		const auto& decode = srgb ? srgbToLinear_() : unormToFloat_();
+
+		// Source decoded to float, then filtered horizontally, then vertically straight into the destination.
+		std::vector<float> decoded(source.Pixels.size());
+		parallelFor_(jobSystem, source.Height, [&source, &decoded, &decode](const uint32_t begin, const uint32_t end)
+		{
+			for (auto i = static_cast<size_t>(begin) * source.Width * 4; i < static_cast<size_t>(end) * source.Width * 4;
+			     ++i)
+			{
+				decoded[i] = i % 4 == 3 ? static_cast<float>(source.Pixels[i]) / 255.0f : decode[source.Pixels[i]];
+			}
+		});
+
+		std::vector<float> horizontal(static_cast<size_t>(level.Width) * source.Height * 4);
+		parallelFor_(jobSystem, source.Height, [&](const uint32_t begin, const uint32_t end)
+		{
+			for (auto y = begin; y < end; ++y)
+			{
+				const auto* row = &decoded[static_cast<size_t>(y) * source.Width * 4];
+				for (uint32_t x = 0; x < level.Width; ++x)
+				{
+					filterTexel_(kernel, x, source.Width, [row](const uint32_t sourceX)
+					{
+						return &row[static_cast<size_t>(sourceX) * 4];
+					}, &horizontal[(static_cast<size_t>(y) * level.Width + x) * 4]);
+				}
+			}
+		});
+
+		parallelFor_(jobSystem, level.Height, [&](const uint32_t begin, const uint32_t end)
+		{
+			std::array<float, 4> texel{};
+			for (auto y = begin; y < end; ++y)
+			{
+				for (uint32_t x = 0; x < level.Width; ++x)
+				{
+					filterTexel_(kernel, y, source.Height, [&horizontal, &level, x](const uint32_t sourceY)
+					{
+						return &horizontal[(static_cast<size_t>(sourceY) * level.Width + x) * 4];
+					}, texel.data());
+					encodeTexel_(texel.data(), srgb, &level.Pixels[(static_cast<size_t>(y) * level.Width + x) * 4]);
+				}
+			}
+		});
+		return level;
+	}
+
+private:
+	// Weights of the source texels 2x - R + 1 ... 2x + R that destination texel x is filtered from.
+	using Kernel = std::vector<float>;
+
+	static const inline Kernel BOX_KERNEL = {0.5f, 0.5f};
+	static const inline uint32_t ROWS_PER_JOB = 16;
+	static const inline size_t LINEAR_TO_SRGB_SIZE = 4096;
+
+	static const Kernel& kaiserKernel_()
+	{
+		static const Kernel kernel = []
+		{
+			const auto pi = 3.14159265358979f;
+			const auto radius = 3.0f;
+			const auto beta = 4.0f;
+			// Zeroth-order modified Bessel function of the first kind, by its power series.
+			const auto bessel = [](const float x)
+			{
+				auto sum = 1.0f;
+				auto term = 1.0f;
+				for (auto k = 1; k < 16; ++k)
+				{
+					term *= x * x / (4.0f * static_cast<float>(k * k));
+					sum += term;
+				}
+				return sum;
+			};
+
+			Kernel weights;
+			auto total = 0.0f;
+			for (auto i = 0; i < static_cast<int>(radius) * 2; ++i)
+			{
+				// Distance from the destination texel's center, in source texels. The cutoff is half the source's.
+				const auto distance = static_cast<float>(i) - radius + 0.5f;
+				const auto x = distance / 2.0f;
+				const auto sinc = std::sin(pi * x) / (pi * x);
+				const auto window = bessel(beta * std::sqrt(1.0f - (distance / radius) * (distance / radius))) /
+					bessel(beta);
+				weights.push_back(sinc * window);
+				total += weights.back();
+			}
+
+			for (auto& weight : weights)
+			{
+				weight /= total;
+			}
+			return weights;
+		}();
+		return kernel;
+	}
+
+	static const std::array<float, 256>& srgbToLinear_()
+	{
+		static const auto table = []
+		{
+			std::array<float, 256> values{};
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				const auto value = static_cast<float>(i) / 255.0f;
+				values[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+			}
+			return values;
+		}();
+		return table;
+	}
+
+	static const std::array<float, 256>& unormToFloat_()
+	{
+		static const auto table = []
+		{
+			std::array<float, 256> values{};
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				values[i] = static_cast<float>(i) / 255.0f;
+			}
+			return values;
+		}();
+		return table;
+	}
+
+	static const std::array<unsigned char, LINEAR_TO_SRGB_SIZE>& linearToSrgb_()
+	{
+		static const auto table = []
+		{
+			std::array<unsigned char, LINEAR_TO_SRGB_SIZE> values{};
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				const auto value = static_cast<float>(i) / static_cast<float>(values.size() - 1);
+				const auto encoded = value <= 0.0031308f
+					                     ? value * 12.92f
+					                     : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+				values[i] = static_cast<unsigned char>(std::lround(std::clamp(encoded, 0.0f, 1.0f) * 255.0f));
+			}
+			return values;
+		}();
+		return table;
+	}
+
+	template <typename Body>
+	static void parallelFor_(JobSystem* jobSystem, const uint32_t count, Body&& body)
+	{
+		if (jobSystem == nullptr)
+		{
+			body(0, count);
+			return;
+		}
+
+		JobSystem::Counter counter;
+		jobSystem->ParallelFor(0, count, ROWS_PER_JOB, body, counter);
+		jobSystem->Wait(counter);
+	}
+
+	// Filters destination texel index along one axis, reading source texels through texelAt, clamped to [0, size).
+	template <typename TexelAt>
+	static void filterTexel_(const Kernel& kernel, const uint32_t index, const uint32_t size, TexelAt&& texelAt,
+	                         float* out)
+	{
+		const auto first = static_cast<int64_t>(index) * 2 - static_cast<int64_t>(kernel.size() / 2) + 1;
+#ifdef MIP_GENERATOR_SSE
+		auto sum = _mm_setzero_ps();
+		for (size_t i = 0; i < kernel.size(); ++i)
+		{
+			const auto sourceIndex = static_cast<uint32_t>(std::clamp<int64_t>(first + static_cast<int64_t>(i), 0,
+			                                                                    size - 1));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel[i]), _mm_loadu_ps(texelAt(sourceIndex))));
+		}
+		_mm_storeu_ps(out, sum);
+#else
+		std::fill(out, out + 4, 0.0f);
+		for (size_t i = 0; i < kernel.size(); ++i)
+		{
+			const auto sourceIndex = static_cast<uint32_t>(std::clamp<int64_t>(first + static_cast<int64_t>(i), 0,
+			                                                                    size - 1));
+			const auto* texel = texelAt(sourceIndex);
+			for (size_t c = 0; c < 4; ++c)
+			{
+				out[c] += kernel[i] * texel[c];
+			}
+		}
+#endif
+	}
+
+	static void encodeTexel_(const float* texel, const bool srgb, unsigned char* out)
+	{
+		const auto& encode = linearToSrgb_();
+		for (size_t c = 0; c < 4; ++c)
+		{
+			// Sharper kernels overshoot a little around edges.
+			const auto value = std::clamp(texel[c], 0.0f, 1.0f);
+			out[c] = srgb && c < 3
+				         ? encode[static_cast<size_t>(std::lround(value * static_cast<float>(LINEAR_TO_SRGB_SIZE - 1)))]
+				         : static_cast<unsigned char>(std::lround(value * 255.0f));
+		}
+	}
+};
@@ -1,15 +1,56 @@
 #pragma once
 
 #include "stdafx.h"
-#include "Particle.h"
+#include "ParticleEmitter.h"
+#include "ParticlePool.h"
+#include "ParticleRandom.h"
+#include "ParticleKernels.h"
+#include "ParticleInstance.h"
+#include "JobSystem.h"
 #include "Buffer.h"
+#include "StagingRing.h"
 
 #include <vector>
-#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <new>
 
 class ParticleEffect : public Mesh
 {
 public:
+	// Vertices expands every particle into six full ::Vertex structs on the CPU. Instanced draws one static unit quad
+	// per particle instead, and only uploads a compact ::ParticleInstance per particle, using the particle pipeline.
+	// Compute draws the same way as Instanced, but the particles live in a device-local storage buffer, and are
+	// simulated by assets/shaders/particle.comp, which writes the instance buffer directly; nothing is uploaded per frame.
+	// The emitter still runs on the CPU, and the shader respawns dead particles from the counts it pushes.
+	enum class RenderMode
+	{
+		Vertices,
+		Instanced,
+		Compute
+	};
+
+	// Matches the push constant block in assets/shaders/particle.comp. 64-bit values are split into two words, low word
+	// first.
+	struct ComputePushConstants
+	{
+		glm::vec4 EmitterPositionSize;
+		uint32_t Seed[2];
+		uint32_t FirstSpawnIndex[2];
+		float Step;
+		uint32_t Count;
+		uint32_t SpawnCount;
+	};
+
+	// Matches the std430 Particle struct in assets/shaders/particle.comp. Dead particles have a life of zero or less.
+	struct GpuParticle
+	{
+		glm::vec4 PositionSize;
+		glm::vec4 VelocityLife;
+		glm::vec4 Color;
+	};
+
 	// TODO: [zpuls 2020-07-27T20:30] dynamically figure out how large of a ::VertexBuffer to allocate, instead of using a hard-coded value of ::numParticles_ * 6
 	/*ParticleEffect(const VulkanDeviceContext deviceContext, const std::shared_ptr<vk::CommandPool>& commandPool,
 	               const glm::vec3 position, const uint32_t numParticles, const float particleSize,
@@ -33,23 +74,35 @@ public:
 
 	ParticleEffect(const VulkanDeviceContext& deviceContext, vk::UniqueCommandPool& commandPool,
 	               const uint32_t transformIndex, const uint32_t textureIndex,
-	               const uint32_t descriptorSetIndex, const glm::vec3& position, const uint32_t numParticles,
-	               const float particleSize, const uint32_t maxFramesInFlight) :
-		Mesh(deviceContext, commandPool, false, transformIndex, textureIndex, descriptorSetIndex),
-		position_(position), numParticles_(numParticles), particleSize_(particleSize),
-		particles_(numParticles, Particle{}),
-		stagingBuffer_(std::make_shared<VertexBuffer>(deviceContext_, commandPool_, numParticles_ * 6 * sizeof(Vertex),
-		                                              vk::BufferUsageFlagBits::eTransferSrc,
-		                                              vk::SharingMode::eExclusive,
-		                                              vk::MemoryPropertyFlagBits::eHostVisible |
-		                                              vk::MemoryPropertyFlagBits::eHostCoherent,
-		                                              "ParticleEffect::stagingBuffer_"))
+	               const uint32_t descriptorSetIndex, const glm::vec3& position, const ParticleEmitter& emitter,
+	               const float particleSize, const uint32_t maxFramesInFlight,
+	               const RenderMode renderMode = RenderMode::Instanced, const uint32_t computeDescriptorSetIndex = 0,
+	               const glm::vec4& uvRect = FULL_UV_RECT) :
+		Mesh(deviceContext, commandPool, false, transformIndex, textureIndex, descriptorSetIndex, uvRect),
+		position_(position), numParticles_(emitter.GetMaxAlive()), particleSize_(particleSize), renderMode_(renderMode),
+		computeDescriptorSetIndex_(computeDescriptorSetIndex), emitter_(emitter), random_(emitter.GetSeed()),
+		particles_(numParticles_)
 	{
 		DebugMessage(
 			"ParticleEffect::ParticleEffect(position={x=" + std::to_string(position_.x) + ",y=" +
-			std::to_string(position_.y) + ",z=" + std::to_string(position_.z) + "},numParticles=" +
+			std::to_string(position_.y) + ",z=" + std::to_string(position_.z) + "},maxAlive=" +
 			std::to_string(numParticles_) + ",particleSize=" + std::to_string(particleSize_) + ")");
-		Create(setupParticlesAndGenerateVertices_(position_, numParticles_, particleSize_), {}, maxFramesInFlight);
+
+		if (renderMode_ == RenderMode::Compute)
+		{
+			createComputeBuffers_();
+		}
+		else
+		{
+			// Rewritten every frame, so each frame in flight gets its own slice, read by the GPU straight from host memory.
+			frameBuffer_ = std::make_shared<DynamicVertexBuffer>(deviceContext_, commandPool_,
+			                                                     numParticles_ * getParticleStride_(), maxFramesInFlight,
+			                                                     "ParticleEffect::frameBuffer_");
+			spawnParticles_(emitter_.Emit(0.0f, 0));
+		}
+
+		// The unit quad is only read by the instanced modes, RenderMode::Vertices binds frameBuffer_ over it.
+		Create(generateUnitQuad_(), {});
 	}
 
 	~ParticleEffect()
@@ -57,44 +110,452 @@ public:
 		DebugMessage("ParticleEffect::~ParticleEffect()");
 	}
 
-	void Update(const float deltaTime)
+	// Simulates the effect, splitting the particle range into chunks on the given JobSystem. Dead particles are then
+	// compacted out of the pool and new ones spawned, and each chunk of the live range writes its quads (or instances)
+	// straight into the frame's slice of the dynamic vertex buffer. This does not record or submit any Vulkan commands,
+	// so several effects can be updated in parallel.
+	void Update(const float deltaTime, const uint32_t frameIndex, JobSystem& jobSystem)
+	{
+		if (renderMode_ == RenderMode::Compute)
+		{
+			updateCompute_(deltaTime);
+			return;
+		}
+
+		mappedData_ = frameBuffer_->Acquire(frameIndex);
+
+		const auto kernel = ParticleKernels::GetIntegrateKernel();
+		const auto step = DAMPENING * deltaTime;
+
+		JobSystem::Counter integrateCounter;
+		jobSystem.ParallelFor(0, particles_.GetAliveCount(), SIMULATION_CHUNK_SIZE,
+		                      [this, kernel, step](const uint32_t begin, const uint32_t end)
+		                      {
+			                      kernel(particles_, begin, end, step);
+		                      }, integrateCounter);
+		jobSystem.Wait(integrateCounter);
+
+		// Swap-removal moves particles across chunk boundaries, so compaction stays on this thread.
+		particles_.RemoveDead();
+		spawnParticles_(emitter_.Emit(deltaTime, particles_.GetAliveCount()), &jobSystem);
+
+		JobSystem::Counter writeCounter;
+		jobSystem.ParallelFor(0, particles_.GetAliveCount(), SIMULATION_CHUNK_SIZE,
+		                      [this](const uint32_t begin, const uint32_t end)
+		                      {
+			                      writeParticles_(begin, end);
+		                      }, writeCounter);
+		jobSystem.Wait(writeCounter);
+	}
+
+	// Called once the frame's draw has been recorded, with the fence its submission signals. The frame's slice won't be
+	// written again until that fence is signaled.
+	void Release(const uint32_t frameIndex, const vk::Fence fence)
+	{
+		if (frameBuffer_)
+		{
+			frameBuffer_->Release(frameIndex, fence);
+		}
+	}
+
+	// Records the compute simulation step that Update() prepared, for RenderMode::Compute effects. Must be recorded
+	// outside of a render pass, with the compute pipeline and this effect's compute descriptor set already bound.
+	void Dispatch(vk::UniqueCommandBuffer& commandBuffer, vk::UniquePipelineLayout& pipelineLayout) const
+	{
+		DebugMessage("ParticleEffect::Dispatch()");
+
+		// The previous dispatch may still be claiming spawns when the counter is cleared for this one.
+		const vk::BufferMemoryBarrier preFillBarrier(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+		                                             vk::AccessFlagBits::eTransferWrite, VK_QUEUE_FAMILY_IGNORED,
+		                                             VK_QUEUE_FAMILY_IGNORED, spawnCounterBuffer_->GetHandle(), 0,
+		                                             VK_WHOLE_SIZE);
+		commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+		                               vk::PipelineStageFlagBits::eTransfer, {}, nullptr, preFillBarrier, nullptr);
+		commandBuffer->fillBuffer(spawnCounterBuffer_->GetHandle(), 0, VK_WHOLE_SIZE, 0);
+
+		// The previous frame's draw may still be reading the instances this dispatch is about to overwrite.
+		const std::array<vk::BufferMemoryBarrier, 3> preDispatchBarriers = {
+			vk::BufferMemoryBarrier(vk::AccessFlagBits::eShaderWrite,
+			                        vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+			                        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, stateBuffer_->GetHandle(), 0,
+			                        VK_WHOLE_SIZE),
+			vk::BufferMemoryBarrier(vk::AccessFlagBits::eVertexAttributeRead, vk::AccessFlagBits::eShaderWrite,
+			                        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, instanceBuffer_->GetHandle(), 0,
+			                        VK_WHOLE_SIZE),
+			vk::BufferMemoryBarrier(vk::AccessFlagBits::eTransferWrite,
+			                        vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+			                        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+			                        spawnCounterBuffer_->GetHandle(), 0, VK_WHOLE_SIZE)
+		};
+		commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eVertexInput |
+		                               vk::PipelineStageFlagBits::eComputeShader |
+		                               vk::PipelineStageFlagBits::eTransfer,
+		                               vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, preDispatchBarriers,
+		                               nullptr);
+
+		// Every slot is simulated, live particles are scattered across the whole state buffer.
+		commandBuffer->pushConstants(pipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0,
+		                             sizeof(ComputePushConstants), &computePushConstants_);
+		commandBuffer->dispatch((numParticles_ + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE, 1, 1);
+
+		const vk::BufferMemoryBarrier postDispatchBarrier(vk::AccessFlagBits::eShaderWrite,
+		                                                  vk::AccessFlagBits::eVertexAttributeRead,
+		                                                  VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+		                                                  instanceBuffer_->GetHandle(), 0, VK_WHOLE_SIZE);
+		commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+		                               vk::PipelineStageFlagBits::eVertexInput, {}, nullptr, postDispatchBarrier,
+		                               nullptr);
+	}
+
+	void BindMeshData(const uint32_t frameIndex, vk::UniqueCommandBuffer& commandBuffer) const
+	{
+		Mesh::BindMeshData(frameIndex, commandBuffer);
+		switch (renderMode_)
+		{
+		case RenderMode::Vertices:
+			frameBuffer_->Bind(commandBuffer, 0, frameIndex);
+			break;
+		case RenderMode::Instanced:
+			frameBuffer_->Bind(commandBuffer, 1, frameIndex);
+			break;
+		case RenderMode::Compute:
+			instanceBuffer_->Bind(commandBuffer);
+			break;
+		}
+	}
+
+	void Draw(vk::UniqueCommandBuffer& commandBuffer) const
+	{
+		DebugMessage("ParticleEffect::Draw()");
+		const auto aliveCount = GetAliveCount();
+		if (aliveCount == 0)
+		{
+			return;
+		}
+
+		switch (renderMode_)
+		{
+		case RenderMode::Vertices:
+			commandBuffer->draw(aliveCount * VERTICES_PER_PARTICLE, 1, 0, 0);
+			break;
+		case RenderMode::Instanced:
+			commandBuffer->draw(VERTICES_PER_PARTICLE, aliveCount, 0, 0);
+			break;
+		case RenderMode::Compute:
+			// Draws every slot, not just the alive ones: the shader respawns into whichever slots are dead, so the alive
+			// particles are scattered across the instance buffer, and aliveCount can't bound the instance range. Dead slots
+			// are degenerate quads, see assets/shaders/particle.comp, so they cost VERTICES_PER_PARTICLE vertex shader
+			// invocations each, but no fill rate. numParticles_ is the emitter's maxAlive, which a steadily emitting effect
+			// runs close to anyway. Drawing only the alive slots would take the shader compacting them and writing the
+			// instance count for a drawIndirect.
+			commandBuffer->draw(VERTICES_PER_PARTICLE, numParticles_, 0, 0);
+			break;
+		}
+	}
+
+	[[nodiscard]] RenderMode GetRenderMode() const
+	{
+		return renderMode_;
+	}
+
+	[[nodiscard]] ParticleEmitter& GetEmitter()
+	{
+		return emitter_;
+	}
+
+	[[nodiscard]] uint32_t GetAliveCount() const
+	{
+		return renderMode_ == RenderMode::Compute ? computeAliveCount_ : particles_.GetAliveCount();
+	}
+
+	// The simulated particles of the CPU render modes. Compute effects only keep their initial burst here.
+	[[nodiscard]] const ParticlePool& GetParticles() const
+	{
+		return particles_;
+	}
+
+	[[nodiscard]] uint32_t GetComputeDescriptorSetIndex() const
+	{
+		return computeDescriptorSetIndex_;
+	}
+
+	[[nodiscard]] std::shared_ptr<Buffer> GetStateBuffer() const
 	{
-		const auto particleVertices = updateParticlesAndGenerateVertices_(deltaTime);
-		auto vertexBufferSize = particleVertices.size() * sizeof(particleVertices[0]);
-		stagingBuffer_->Fill(0, vertexBufferSize, &particleVertices[0]);
-		stagingBuffer_->CopyTo(vertexBuffer_);
+		return stateBuffer_;
+	}
+
+	[[nodiscard]] std::shared_ptr<InstanceBuffer> GetInstanceBuffer() const
+	{
+		return instanceBuffer_;
+	}
+
+	[[nodiscard]] std::shared_ptr<Buffer> GetSpawnCounterBuffer() const
+	{
+		return spawnCounterBuffer_;
+	}
+
+	// Bindings of the compute descriptor set, matching assets/shaders/particle.comp: the state buffer, the instance
+	// buffer, and the spawn counter.
+	static std::array<vk::DescriptorSetLayoutBinding, 3> GetComputeDescriptorSetLayoutBindings()
+	{
+		return {
+			vk::DescriptorSetLayoutBinding{0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+			vk::DescriptorSetLayoutBinding{1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+			vk::DescriptorSetLayoutBinding{2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute}
+		};
 	}
 
 private:
+	// Particles spawned on the same frame, see updateCompute_().
+	struct Generation
+	{
+		float Life;
+		uint32_t Count;
+	};
+
 	glm::vec3 position_;
 	uint32_t numParticles_;
 	float particleSize_;
-	std::vector<Particle> particles_;
-	std::shared_ptr<VertexBuffer> stagingBuffer_;
+	RenderMode renderMode_;
+	uint32_t computeDescriptorSetIndex_;
+	ParticleEmitter emitter_;
+	ParticleRandom random_;
+	// Total number of particles ever spawned, each particle's random values are keyed on its spawn index.
+	uint64_t spawnedCount_ = 0;
+	ParticlePool particles_;
+	std::shared_ptr<DynamicVertexBuffer> frameBuffer_;
+	std::shared_ptr<InstanceBuffer> instanceBuffer_;
+	std::shared_ptr<Buffer> stateBuffer_;
+	std::shared_ptr<Buffer> spawnCounterBuffer_;
+	std::deque<Generation> generations_;
+	uint32_t computeAliveCount_ = 0;
+	ComputePushConstants computePushConstants_{};
+	void* mappedData_ = nullptr;
+
+	static const inline float DAMPENING = 0.05f;
+	static const inline uint32_t VERTICES_PER_PARTICLE = 6;
+	// Kept a multiple of ParticlePool::LANE_WIDTH, so every chunk but the last runs in full SIMD lanes.
+	static const inline uint32_t SIMULATION_CHUNK_SIZE = 16384;
+	// Matches local_size_x in assets/shaders/particle.comp.
+	static const inline uint32_t COMPUTE_WORKGROUP_SIZE = 256;
+	static const inline uint32_t RANDOM_STREAM_VELOCITY_X = 0;
+	static const inline uint32_t RANDOM_STREAM_VELOCITY_Z = 1;
+
+	vk::DeviceSize getParticleStride_() const
+	{
+		switch (renderMode_)
+		{
+		case RenderMode::Instanced:
+			return sizeof(ParticleInstance);
+		case RenderMode::Compute:
+			return sizeof(GpuParticle);
+		default:
+			return VERTICES_PER_PARTICLE * sizeof(Vertex);
+		}
+	}
+
+	void writeParticles_(const uint32_t begin, const uint32_t end) const
+	{
+		switch (renderMode_)
+		{
+		case RenderMode::Instanced:
+			writeInstances_(begin, end, static_cast<ParticleInstance*>(mappedData_));
+			break;
+		case RenderMode::Compute:
+			writeGpuParticles_(begin, end, static_cast<GpuParticle*>(mappedData_));
+			break;
+		default:
+			writeVertices_(begin, end, static_cast<Vertex*>(mappedData_));
+			break;
+		}
+	}
+
+	void writeVertices_(const uint32_t begin, const uint32_t end, Vertex* vertices) const
+	{
+		// Opposite corners of the effect's UV rect, the instanced modes get theirs from the unit quad.
+		const auto uv0 = RemapTexCoord(glm::vec2(0.0f, 0.0f));
+		const auto uv1 = RemapTexCoord(glm::vec2(1.0f, 1.0f));
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto position = particles_.GetPosition(i);
+			const auto color = particles_.GetColor(i);
+			const auto halfSize = particles_.GetSize(i) / 2.0f;
+			const auto quad = vertices + static_cast<size_t>(i) * VERTICES_PER_PARTICLE;
+			new(quad + 0) Vertex(glm::vec3(position.x - halfSize, position.y - halfSize, position.z), color, glm::vec2(uv0.x, uv0.y));
+			new(quad + 1) Vertex(glm::vec3(position.x + halfSize, position.y - halfSize, position.z), color, glm::vec2(uv1.x, uv0.y));
+			new(quad + 2) Vertex(glm::vec3(position.x - halfSize, position.y + halfSize, position.z), color, glm::vec2(uv0.x, uv1.y));
+			new(quad + 3) Vertex(glm::vec3(position.x + halfSize, position.y - halfSize, position.z), color, glm::vec2(uv1.x, uv0.y));
+			new(quad + 4) Vertex(glm::vec3(position.x + halfSize, position.y + halfSize, position.z), color, glm::vec2(uv1.x, uv1.y));
+			new(quad + 5) Vertex(glm::vec3(position.x - halfSize, position.y + halfSize, position.z), color, glm::vec2(uv0.x, uv1.y));
+		}
+	}
+
+	void writeInstances_(const uint32_t begin, const uint32_t end, ParticleInstance* instances) const
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			new(instances + i) ParticleInstance(particles_.GetPosition(i), particles_.GetSize(i), particles_.GetColor(i));
+		}
+	}
+
+	void writeGpuParticles_(const uint32_t begin, const uint32_t end, GpuParticle* gpuParticles) const
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto color = particles_.GetColor(i);
+			const glm::vec3 velocity(particles_.Data(ParticlePool::Attribute::VelocityX)[i],
+			                         particles_.Data(ParticlePool::Attribute::VelocityY)[i],
+			                         particles_.Data(ParticlePool::Attribute::VelocityZ)[i]);
+			new(gpuParticles + i) GpuParticle{
+				glm::vec4(particles_.GetPosition(i), particles_.GetSize(i)), glm::vec4(velocity, color.a),
+				glm::vec4(glm::vec3(color), 0.0f)
+			};
+		}
+	}
+
+	// Unit quad centered on the origin, scaled by each instance's size in assets/shaders/particle.vert.
+	static std::vector<Vertex> generateUnitQuad_()
+	{
+		const glm::vec4 white(1.0f);
+		return {
+			Vertex(glm::vec3(-0.5f, -0.5f, 0.0f), white, glm::vec2(0.0f, 0.0f)),
+			Vertex(glm::vec3(0.5f, -0.5f, 0.0f), white, glm::vec2(1.0f, 0.0f)),
+			Vertex(glm::vec3(-0.5f, 0.5f, 0.0f), white, glm::vec2(0.0f, 1.0f)),
+			Vertex(glm::vec3(0.5f, -0.5f, 0.0f), white, glm::vec2(1.0f, 0.0f)),
+			Vertex(glm::vec3(0.5f, 0.5f, 0.0f), white, glm::vec2(1.0f, 1.0f)),
+			Vertex(glm::vec3(-0.5f, 0.5f, 0.0f), white, glm::vec2(0.0f, 1.0f))
+		};
+	}
 
-	std::vector<Vertex> updateParticlesAndGenerateVertices_(const float deltaTime)
+	// Allocates count particles and initializes them in bulk. Large bursts are split across the JobSystem, which needs
+	// no synchronization, since every random value only depends on the particle's spawn index.
+	void spawnParticles_(const uint32_t count, JobSystem* jobSystem = nullptr)
 	{
-		std::vector<Vertex> vertices;
-		for (auto particle : particles_)
+		if (count == 0)
+		{
+			return;
+		}
+
+		const auto begin = particles_.Allocate(count);
+		const auto firstSpawnIndex = spawnedCount_;
+		spawnedCount_ += count;
+
+		if (jobSystem == nullptr)
 		{
-			particle.Update(deltaTime);
-			const auto& particleVertices = particle.GetVertices();
-			vertices.insert(vertices.end(), std::begin(particleVertices), std::end(particleVertices));
+			initializeParticles_(begin, begin + count, firstSpawnIndex);
+			return;
 		}
 
-		return vertices;
+		JobSystem::Counter counter;
+		jobSystem->ParallelFor(begin, begin + count, SIMULATION_CHUNK_SIZE,
+		                       [this, begin, firstSpawnIndex](const uint32_t chunkBegin, const uint32_t chunkEnd)
+		                       {
+			                       initializeParticles_(chunkBegin, chunkEnd, firstSpawnIndex + (chunkBegin - begin));
+		                       }, counter);
+		jobSystem->Wait(counter);
 	}
 
-	std::vector<Vertex> setupParticlesAndGenerateVertices_(const glm::vec3 position, const uint32_t numParticles, const float particleSize)
+	void initializeParticles_(const uint32_t begin, const uint32_t end, const uint64_t firstSpawnIndex)
 	{
-		for (uint32_t i = 0; i < numParticles; ++i)
+		const auto count = end - begin;
+		const auto velocityX = particles_.Data(ParticlePool::Attribute::VelocityX) + begin;
+		const auto velocityY = particles_.Data(ParticlePool::Attribute::VelocityY) + begin;
+		const auto velocityZ = particles_.Data(ParticlePool::Attribute::VelocityZ) + begin;
+		random_.FillUniform(velocityX, count, firstSpawnIndex, RANDOM_STREAM_VELOCITY_X, 0.01f, 0.76f);
+		random_.FillUniform(velocityZ, count, firstSpawnIndex, RANDOM_STREAM_VELOCITY_Z, 0.01f, 0.76f);
+		for (uint32_t i = 0; i < count; ++i)
 		{
-			auto magX = static_cast<float>(1 + rand() % 75) / 100.0f;
-			auto magZ = static_cast<float>(1 + rand() % 75) / 100.0f;
-			auto directionVector = glm::normalize(glm::vec3(magX, 1.0f, magZ));
-			particles_[i] = Particle(position, directionVector, glm::vec3(1.0f, 0.0f, 0.0f), particleSize);
+			const auto direction = glm::normalize(glm::vec3(velocityX[i], 1.0f, velocityZ[i]));
+			velocityX[i] = direction.x;
+			velocityY[i] = direction.y;
+			velocityZ[i] = direction.z;
 		}
 
-		return updateParticlesAndGenerateVertices_(0.0f);
+		std::fill_n(particles_.Data(ParticlePool::Attribute::PositionX) + begin, count, position_.x);
+		std::fill_n(particles_.Data(ParticlePool::Attribute::PositionY) + begin, count, position_.y);
+		std::fill_n(particles_.Data(ParticlePool::Attribute::PositionZ) + begin, count, position_.z);
+		std::fill_n(particles_.Data(ParticlePool::Attribute::ColorR) + begin, count, 1.0f);
+		std::fill_n(particles_.Data(ParticlePool::Attribute::ColorG) + begin, count, 0.0f);
+		std::fill_n(particles_.Data(ParticlePool::Attribute::ColorB) + begin, count, 0.0f);
+		std::fill_n(particles_.Data(ParticlePool::Attribute::Size) + begin, count, particleSize_);
+		std::fill_n(particles_.Data(ParticlePool::Attribute::Life) + begin, count, 1.0f);
+	}
+
+	// Compute effects upload their initial burst once, through the staging ring, and every other slot starts out dead.
+	// Later spawns are made by the shader.
+	void createComputeBuffers_()
+	{
+		instanceBuffer_ = std::make_shared<InstanceBuffer>(deviceContext_, commandPool_,
+		                                                   numParticles_ * sizeof(ParticleInstance),
+		                                                   vk::BufferUsageFlagBits::eStorageBuffer |
+		                                                   vk::BufferUsageFlagBits::eVertexBuffer,
+		                                                   vk::SharingMode::eExclusive,
+		                                                   vk::MemoryPropertyFlagBits::eDeviceLocal,
+		                                                   "ParticleEffect::instanceBuffer_");
+		// Also a transfer source, so tests can read the simulation back.
+		stateBuffer_ = std::make_shared<GenericBuffer>(deviceContext_, commandPool_,
+		                                               numParticles_ * sizeof(GpuParticle),
+		                                               vk::BufferUsageFlagBits::eTransferSrc |
+		                                               vk::BufferUsageFlagBits::eTransferDst |
+		                                               vk::BufferUsageFlagBits::eStorageBuffer,
+		                                               vk::SharingMode::eExclusive,
+		                                               vk::MemoryPropertyFlagBits::eDeviceLocal,
+		                                               "ParticleEffect::stateBuffer_");
+		spawnCounterBuffer_ = std::make_shared<GenericBuffer>(deviceContext_, commandPool_, sizeof(uint32_t),
+		                                                      vk::BufferUsageFlagBits::eTransferDst |
+		                                                      vk::BufferUsageFlagBits::eStorageBuffer,
+		                                                      vk::SharingMode::eExclusive,
+		                                                      vk::MemoryPropertyFlagBits::eDeviceLocal,
+		                                                      "ParticleEffect::spawnCounterBuffer_");
+
+		auto& staging = *deviceContext_.Staging;
+		const auto stagingRegion = staging.Allocate(numParticles_ * sizeof(GpuParticle));
+		mappedData_ = stagingRegion.Data;
+		spawnParticles_(emitter_.Emit(0.0f, 0));
+		const auto burstCount = particles_.GetAliveCount();
+		writeParticles_(0, burstCount);
+		std::memset(static_cast<GpuParticle*>(mappedData_) + burstCount, 0,
+		            static_cast<size_t>(numParticles_ - burstCount) * sizeof(GpuParticle));
+		staging.CopyTo(stagingRegion, stateBuffer_);
+		mappedData_ = nullptr;
+
+		if (burstCount > 0)
+		{
+			generations_.push_back({1.0f, burstCount});
+			computeAliveCount_ = burstCount;
+		}
+	}
+
+	// The GPU keeps the particles, but every particle spawned on the same frame loses the same life each frame, with
+	// the same float math as the shader. So tracking each frame's spawns as one Generation tells exactly how many
+	// particles are alive, and the emitter is capped the same way as on the CPU path, without reading anything back.
+	// This also means the shader always finds enough dead slots for every spawn it is given.
+	void updateCompute_(const float deltaTime)
+	{
+		const auto step = DAMPENING * deltaTime;
+		for (auto& generation : generations_)
+		{
+			generation.Life -= step;
+		}
+		while (!generations_.empty() && generations_.front().Life <= 0.0f)
+		{
+			computeAliveCount_ -= generations_.front().Count;
+			generations_.pop_front();
+		}
+
+		const auto spawnCount = emitter_.Emit(deltaTime, computeAliveCount_);
+		computePushConstants_ = {
+			glm::vec4(position_, particleSize_),
+			{static_cast<uint32_t>(emitter_.GetSeed()), static_cast<uint32_t>(emitter_.GetSeed() >> 32)},
+			{static_cast<uint32_t>(spawnedCount_), static_cast<uint32_t>(spawnedCount_ >> 32)},
+			step, numParticles_, spawnCount
+		};
+		spawnedCount_ += spawnCount;
+
+		if (spawnCount > 0)
+		{
+			generations_.push_back({1.0f, spawnCount});
+			computeAliveCount_ += spawnCount;
+		}
 	}
 };
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "stdafx.h"
+
+#include <algorithm>
+
+// Decides how many particles a ParticleEffect spawns each frame: a continuous spawn rate, plus one-off bursts, capped so
+// the number of live particles never exceeds maxAlive. The cap is also the capacity of the effect's ParticlePool.
+class ParticleEmitter
+{
+public:
+	ParticleEmitter(const float spawnRate, const uint32_t maxAlive, const uint32_t initialBurst = 0,
+	                const uint64_t seed = 0) :
+		spawnRate_(spawnRate), maxAlive_(maxAlive), pendingBurst_(initialBurst), seed_(seed)
+	{
+		if (maxAlive_ == 0)
+		{
+			throw std::runtime_error("Could not create ParticleEmitter, maxAlive must be greater than zero.");
+		}
+	}
+
+	// Returns the number of particles to spawn this frame, given how many are currently alive.
+	uint32_t Emit(const float deltaTime, const uint32_t aliveCount)
+	{
+		spawnAccumulator_ += spawnRate_ * deltaTime;
+		const auto spawnCount = static_cast<uint32_t>(spawnAccumulator_);
+		spawnAccumulator_ -= static_cast<float>(spawnCount);
+
+		const auto requested = spawnCount + pendingBurst_;
+		pendingBurst_ = 0;
+
+		const auto available = aliveCount < maxAlive_ ? maxAlive_ - aliveCount : 0;
+		return std::min(requested, available);
+	}
+
+	// Spawns count particles at once on the next Emit(), on top of the continuous spawn rate.
+	void Burst(const uint32_t count)
+	{
+		pendingBurst_ += count;
+	}
+
+	void SetSpawnRate(const float spawnRate)
+	{
+		spawnRate_ = spawnRate;
+	}
+
+	[[nodiscard]] float GetSpawnRate() const
+	{
+		return spawnRate_;
+	}
+
+	[[nodiscard]] uint32_t GetMaxAlive() const
+	{
+		return maxAlive_;
+	}
+
+	// Seeds the effect's ParticleRandom, so two runs with the same seeds spawn exactly the same particles.
+	[[nodiscard]] uint64_t GetSeed() const
+	{
+		return seed_;
+	}
+
+private:
+	float spawnRate_;
+	uint32_t maxAlive_;
+	uint32_t pendingBurst_;
+	uint64_t seed_;
+	float spawnAccumulator_ = 0.0f;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "stdafx.h"
+
+#include <array>
+
+// Per-instance particle data for instanced rendering. The unit quad is a regular ::Vertex mesh bound at binding 0, every
+// particle only uploads its position, size and packed color here, at binding 1.
+#pragma pack(push, 1)
+struct ParticleInstance
+{
+	glm::vec3 Position;
+	float Size;
+	uint32_t Color;
+
+	ParticleInstance(const glm::vec3& position, const float size, const glm::vec4& color)
+		: Position(position),
+		  Size(size),
+		  Color(PackColor(color))
+	{
+	}
+
+	// Packs a color into vk::Format::eR8G8B8A8Unorm, with red in the lowest byte.
+	static uint32_t PackColor(const glm::vec4& color)
+	{
+		const auto packChannel = [](const float channel)
+		{
+			return static_cast<uint32_t>(std::min(std::max(channel, 0.0f), 1.0f) * 255.0f + 0.5f);
+		};
+		return packChannel(color.r) | (packChannel(color.g) << 8) | (packChannel(color.b) << 16) |
+			(packChannel(color.a) << 24);
+	}
+
+	static vk::VertexInputBindingDescription GetVertexInputBindingDescription()
+	{
+		return vk::VertexInputBindingDescription(1, sizeof(ParticleInstance), vk::VertexInputRate::eInstance);
+	}
+
+	static std::array<vk::VertexInputAttributeDescription, 3> GetVertexInputAttributeDescriptions()
+	{
+		return {
+			vk::VertexInputAttributeDescription(3, 1, vk::Format::eR32G32B32Sfloat, offsetof(ParticleInstance, Position)),
+			vk::VertexInputAttributeDescription(4, 1, vk::Format::eR32Sfloat, offsetof(ParticleInstance, Size)),
+			vk::VertexInputAttributeDescription(5, 1, vk::Format::eR8G8B8A8Unorm, offsetof(ParticleInstance, Color))
+		};
+	}
+};
+#pragma pack(pop)
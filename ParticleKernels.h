@@ -0,0 +1,262 @@
+#pragma once
+
+#include "stdafx.h"
+#include "ParticlePool.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PARTICLE_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Compilers contract multiply/add pairs into FMAs whenever the target has them, which changes rounding. Every kernel opts
+// out, so the results stay bit-identical across instruction sets: GCC through a function attribute, Clang through a
+// pragma at the start of each kernel body, and MSVC through a pragma that holds for the rest of the translation unit.
+// Builds with -ffp-contract=fast or /fp:fast are not supported, tests/ParticleKernelsTests.h checks every kernel against
+// an unfused reference.
+#if defined(__clang__)
+#define PARTICLE_KERNEL_NO_CONTRACT
+#define PARTICLE_KERNEL_BODY_NO_CONTRACT _Pragma("clang fp contract(off)")
+#elif defined(__GNUC__)
+#define PARTICLE_KERNEL_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+#define PARTICLE_KERNEL_BODY_NO_CONTRACT
+#else
+#ifdef _MSC_VER
+#pragma fp_contract(off)
+#endif
+#define PARTICLE_KERNEL_NO_CONTRACT
+#define PARTICLE_KERNEL_BODY_NO_CONTRACT
+#endif
+
+// MSVC lets any translation unit use any intrinsic, GCC/Clang need the instruction set enabled per-function instead.
+#if defined(PARTICLE_KERNELS_X86) && !defined(_MSC_VER)
+#define PARTICLE_KERNEL_TARGET(instructionSet) __attribute__((target(instructionSet))) PARTICLE_KERNEL_NO_CONTRACT
+#else
+#define PARTICLE_KERNEL_TARGET(instructionSet) PARTICLE_KERNEL_NO_CONTRACT
+#endif
+
+// Vectorized particle integration. Every kernel computes position += velocity * step and life -= step for the particles
+// in [begin, end), using exactly the same multiply-then-add sequence as the scalar kernel, so all instruction sets
+// produce bit-identical results. A particle's alpha is its life, so the life update is also its color fade.
+namespace ParticleKernels
+{
+	enum class InstructionSet
+	{
+		Scalar,
+		SSE41,
+		AVX2,
+		AVX512
+	};
+
+	using IntegrateKernel = void(*)(ParticlePool& pool, uint32_t begin, uint32_t end, float step);
+
+	struct Streams
+	{
+		float* PositionX;
+		float* PositionY;
+		float* PositionZ;
+		const float* VelocityX;
+		const float* VelocityY;
+		const float* VelocityZ;
+		float* Life;
+
+		explicit Streams(ParticlePool& pool) :
+			PositionX(pool.Data(ParticlePool::Attribute::PositionX)),
+			PositionY(pool.Data(ParticlePool::Attribute::PositionY)),
+			PositionZ(pool.Data(ParticlePool::Attribute::PositionZ)),
+			VelocityX(pool.Data(ParticlePool::Attribute::VelocityX)),
+			VelocityY(pool.Data(ParticlePool::Attribute::VelocityY)),
+			VelocityZ(pool.Data(ParticlePool::Attribute::VelocityZ)),
+			Life(pool.Data(ParticlePool::Attribute::Life))
+		{
+		}
+	};
+
+	PARTICLE_KERNEL_NO_CONTRACT
+	inline void integrateScalar_(const Streams& streams, const uint32_t begin, const uint32_t end, const float step)
+	{
+		PARTICLE_KERNEL_BODY_NO_CONTRACT
+		for (auto i = begin; i < end; ++i)
+		{
+			streams.PositionX[i] = streams.PositionX[i] + streams.VelocityX[i] * step;
+			streams.PositionY[i] = streams.PositionY[i] + streams.VelocityY[i] * step;
+			streams.PositionZ[i] = streams.PositionZ[i] + streams.VelocityZ[i] * step;
+			streams.Life[i] = streams.Life[i] - step;
+		}
+	}
+
+	inline void IntegrateScalar(ParticlePool& pool, const uint32_t begin, const uint32_t end, const float step)
+	{
+		integrateScalar_(Streams(pool), begin, end, step);
+	}
+
+#ifdef PARTICLE_KERNELS_X86
+	PARTICLE_KERNEL_TARGET("sse4.1")
+	inline void IntegrateSSE41(ParticlePool& pool, const uint32_t begin, const uint32_t end, const float step)
+	{
+		PARTICLE_KERNEL_BODY_NO_CONTRACT
+		const Streams streams(pool);
+		const auto stepLanes = _mm_set1_ps(step);
+		auto i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			_mm_storeu_ps(streams.PositionX + i, _mm_add_ps(_mm_loadu_ps(streams.PositionX + i),
+			                                                _mm_mul_ps(_mm_loadu_ps(streams.VelocityX + i), stepLanes)));
+			_mm_storeu_ps(streams.PositionY + i, _mm_add_ps(_mm_loadu_ps(streams.PositionY + i),
+			                                                _mm_mul_ps(_mm_loadu_ps(streams.VelocityY + i), stepLanes)));
+			_mm_storeu_ps(streams.PositionZ + i, _mm_add_ps(_mm_loadu_ps(streams.PositionZ + i),
+			                                                _mm_mul_ps(_mm_loadu_ps(streams.VelocityZ + i), stepLanes)));
+			_mm_storeu_ps(streams.Life + i, _mm_sub_ps(_mm_loadu_ps(streams.Life + i), stepLanes));
+		}
+		integrateScalar_(streams, i, end, step);
+	}
+
+	PARTICLE_KERNEL_TARGET("avx2")
+	inline void IntegrateAVX2(ParticlePool& pool, const uint32_t begin, const uint32_t end, const float step)
+	{
+		PARTICLE_KERNEL_BODY_NO_CONTRACT
+		const Streams streams(pool);
+		const auto stepLanes = _mm256_set1_ps(step);
+		auto i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			_mm256_storeu_ps(streams.PositionX + i, _mm256_add_ps(_mm256_loadu_ps(streams.PositionX + i),
+			                                                      _mm256_mul_ps(_mm256_loadu_ps(streams.VelocityX + i),
+			                                                                    stepLanes)));
+			_mm256_storeu_ps(streams.PositionY + i, _mm256_add_ps(_mm256_loadu_ps(streams.PositionY + i),
+			                                                      _mm256_mul_ps(_mm256_loadu_ps(streams.VelocityY + i),
+			                                                                    stepLanes)));
+			_mm256_storeu_ps(streams.PositionZ + i, _mm256_add_ps(_mm256_loadu_ps(streams.PositionZ + i),
+			                                                      _mm256_mul_ps(_mm256_loadu_ps(streams.VelocityZ + i),
+			                                                                    stepLanes)));
+			_mm256_storeu_ps(streams.Life + i, _mm256_sub_ps(_mm256_loadu_ps(streams.Life + i), stepLanes));
+		}
+		integrateScalar_(streams, i, end, step);
+	}
+
+	// AVX-512 handles the tail with masked lanes instead of falling back to the scalar loop.
+	PARTICLE_KERNEL_TARGET("avx512f")
+	inline void IntegrateAVX512(ParticlePool& pool, const uint32_t begin, const uint32_t end, const float step)
+	{
+		PARTICLE_KERNEL_BODY_NO_CONTRACT
+		const Streams streams(pool);
+		const auto stepLanes = _mm512_set1_ps(step);
+		for (auto i = begin; i < end; i += 16)
+		{
+			const auto remaining = end - i;
+			const auto mask = static_cast<__mmask16>(remaining >= 16 ? 0xFFFF : (1u << remaining) - 1);
+			_mm512_mask_storeu_ps(streams.PositionX + i, mask,
+			                      _mm512_add_ps(_mm512_maskz_loadu_ps(mask, streams.PositionX + i),
+			                                    _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, streams.VelocityX + i),
+			                                                  stepLanes)));
+			_mm512_mask_storeu_ps(streams.PositionY + i, mask,
+			                      _mm512_add_ps(_mm512_maskz_loadu_ps(mask, streams.PositionY + i),
+			                                    _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, streams.VelocityY + i),
+			                                                  stepLanes)));
+			_mm512_mask_storeu_ps(streams.PositionZ + i, mask,
+			                      _mm512_add_ps(_mm512_maskz_loadu_ps(mask, streams.PositionZ + i),
+			                                    _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, streams.VelocityZ + i),
+			                                                  stepLanes)));
+			_mm512_mask_storeu_ps(streams.Life + i, mask,
+			                      _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, streams.Life + i), stepLanes));
+		}
+	}
+
+	inline void cpuid_(const uint32_t leaf, const uint32_t subleaf, uint32_t registers[4])
+	{
+#if defined(_MSC_VER)
+		int msvcRegisters[4];
+		__cpuidex(msvcRegisters, static_cast<int>(leaf), static_cast<int>(subleaf));
+		for (auto i = 0; i < 4; ++i)
+		{
+			registers[i] = static_cast<uint32_t>(msvcRegisters[i]);
+		}
+#else
+		__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+	}
+
+	inline uint64_t xgetbv_()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+	}
+#endif
+
+	// Picks the widest instruction set that both the CPU and the OS (saved register state) support.
+	inline InstructionSet DetectInstructionSet()
+	{
+#ifdef PARTICLE_KERNELS_X86
+		uint32_t registers[4];
+		cpuid_(0, 0, registers);
+		const auto maxLeaf = registers[0];
+
+		cpuid_(1, 0, registers);
+		const auto hasSSE41 = (registers[2] & (1u << 19)) != 0;
+		const auto hasOSXSAVE = (registers[2] & (1u << 27)) != 0;
+		const auto hasAVX = (registers[2] & (1u << 28)) != 0;
+
+		const auto enabledStates = hasOSXSAVE ? xgetbv_() : 0;
+		const auto osSavesYmm = (enabledStates & 0x6) == 0x6;
+		const auto osSavesZmm = (enabledStates & 0xE6) == 0xE6;
+
+		auto hasAVX2 = false;
+		auto hasAVX512 = false;
+		if (maxLeaf >= 7)
+		{
+			cpuid_(7, 0, registers);
+			hasAVX2 = (registers[1] & (1u << 5)) != 0;
+			hasAVX512 = (registers[1] & (1u << 16)) != 0;
+		}
+
+		if (hasAVX512 && osSavesZmm)
+		{
+			return InstructionSet::AVX512;
+		}
+
+		if (hasAVX && hasAVX2 && osSavesYmm)
+		{
+			return InstructionSet::AVX2;
+		}
+
+		if (hasSSE41)
+		{
+			return InstructionSet::SSE41;
+		}
+#endif
+		return InstructionSet::Scalar;
+	}
+
+	inline IntegrateKernel GetIntegrateKernel(const InstructionSet instructionSet)
+	{
+		switch (instructionSet)
+		{
+#ifdef PARTICLE_KERNELS_X86
+		case InstructionSet::AVX512:
+			return IntegrateAVX512;
+		case InstructionSet::AVX2:
+			return IntegrateAVX2;
+		case InstructionSet::SSE41:
+			return IntegrateSSE41;
+#endif
+		default:
+			return IntegrateScalar;
+		}
+	}
+
+	// The kernel for the current CPU, detected once on first use.
+	inline IntegrateKernel GetIntegrateKernel()
+	{
+		static const auto kernel = GetIntegrateKernel(DetectInstructionSet());
+		return kernel;
+	}
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "stdafx.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+
+// Structure-of-arrays particle storage. Every attribute lives in its own contiguous, 64-byte aligned stream, so the
+// integrator only streams the attributes it actually touches, and can process them in full SIMD lanes.
+class ParticlePool
+{
+public:
+	enum class Attribute
+	{
+		PositionX,
+		PositionY,
+		PositionZ,
+		VelocityX,
+		VelocityY,
+		VelocityZ,
+		ColorR,
+		ColorG,
+		ColorB,
+		Size,
+		Life,
+		Count
+	};
+
+	explicit ParticlePool(const uint32_t capacity) : capacity_(capacity),
+	                                                 streamStride_(alignToLanes_(capacity)),
+	                                                 streams_(allocateStreams_(streamStride_))
+	{
+		DebugMessage("ParticlePool::ParticlePool(capacity=" + std::to_string(capacity_) + ")");
+	}
+
+	~ParticlePool()
+	{
+		DebugMessage("ParticlePool::~ParticlePool()");
+	}
+
+	ParticlePool(const ParticlePool&) = delete;
+	ParticlePool& operator=(const ParticlePool&) = delete;
+
+	// Appends a particle to the end of the live range. Returns the index of the new particle.
+	uint32_t Add(const glm::vec3& position, const glm::vec3& velocity, const glm::vec3& color, const float size)
+	{
+		if (aliveCount_ >= capacity_)
+		{
+			throw std::runtime_error("Could not add particle to ParticlePool, capacity of [" +
+				std::to_string(capacity_) + "] has been reached.");
+		}
+
+		const auto index = aliveCount_++;
+		Data(Attribute::PositionX)[index] = position.x;
+		Data(Attribute::PositionY)[index] = position.y;
+		Data(Attribute::PositionZ)[index] = position.z;
+		Data(Attribute::VelocityX)[index] = velocity.x;
+		Data(Attribute::VelocityY)[index] = velocity.y;
+		Data(Attribute::VelocityZ)[index] = velocity.z;
+		Data(Attribute::ColorR)[index] = color.r;
+		Data(Attribute::ColorG)[index] = color.g;
+		Data(Attribute::ColorB)[index] = color.b;
+		Data(Attribute::Size)[index] = size;
+		Data(Attribute::Life)[index] = 1.0f;
+		return index;
+	}
+
+	// Removes a particle by moving the last live particle into its slot. O(1), but does not preserve order.
+	void Remove(const uint32_t index)
+	{
+		const auto last = --aliveCount_;
+		if (index != last)
+		{
+			for (size_t attribute = 0; attribute < static_cast<size_t>(Attribute::Count); ++attribute)
+			{
+				auto stream = Data(static_cast<Attribute>(attribute));
+				stream[index] = stream[last];
+			}
+		}
+	}
+
+	// Removes every particle whose life has run out, compacting the live range. Returns the number removed.
+	uint32_t RemoveDead()
+	{
+		const auto life = Data(Attribute::Life);
+		const auto previousAliveCount = aliveCount_;
+		for (uint32_t i = 0; i < aliveCount_;)
+		{
+			if (life[i] <= 0.0f)
+			{
+				Remove(i);
+			}
+			else
+			{
+				++i;
+			}
+		}
+
+		return previousAliveCount - aliveCount_;
+	}
+
+	// Appends count particles to the end of the live range without initializing them, so callers can fill each stream
+	// in bulk. Returns the index of the first new particle.
+	uint32_t Allocate(const uint32_t count)
+	{
+		if (count > capacity_ - aliveCount_)
+		{
+			throw std::runtime_error("Could not allocate [" + std::to_string(count) +
+				"] particles in ParticlePool, capacity of [" + std::to_string(capacity_) + "] would be exceeded.");
+		}
+
+		const auto begin = aliveCount_;
+		aliveCount_ += count;
+		return begin;
+	}
+
+	void Clear()
+	{
+		aliveCount_ = 0;
+	}
+
+	float* Data(const Attribute attribute)
+	{
+		return streams_.get() + static_cast<size_t>(attribute) * streamStride_;
+	}
+
+	const float* Data(const Attribute attribute) const
+	{
+		return streams_.get() + static_cast<size_t>(attribute) * streamStride_;
+	}
+
+	glm::vec3 GetPosition(const uint32_t index) const
+	{
+		return {
+			Data(Attribute::PositionX)[index], Data(Attribute::PositionY)[index], Data(Attribute::PositionZ)[index]
+		};
+	}
+
+	// Particles fade out with their remaining life.
+	glm::vec4 GetColor(const uint32_t index) const
+	{
+		return {
+			Data(Attribute::ColorR)[index], Data(Attribute::ColorG)[index], Data(Attribute::ColorB)[index],
+			Data(Attribute::Life)[index]
+		};
+	}
+
+	float GetSize(const uint32_t index) const
+	{
+		return Data(Attribute::Size)[index];
+	}
+
+	[[nodiscard]] uint32_t GetAliveCount() const
+	{
+		return aliveCount_;
+	}
+
+	[[nodiscard]] uint32_t GetCapacity() const
+	{
+		return capacity_;
+	}
+
+	static const inline size_t ALIGNMENT = 64;
+	// Number of floats per ALIGNMENT bytes. Streams are padded to a multiple of this, so a vectorized kernel can always
+	// run a full lane past the live count without touching the neighbouring stream.
+	static const inline size_t LANE_WIDTH = ALIGNMENT / sizeof(float);
+
+private:
+	struct freeStreams_
+	{
+		void operator()(float* ptr) const
+		{
+			::operator delete[](ptr, std::align_val_t(ALIGNMENT));
+		}
+	};
+
+	uint32_t capacity_;
+	uint32_t aliveCount_ = 0;
+	size_t streamStride_;
+	std::unique_ptr<float[], freeStreams_> streams_;
+
+	static size_t alignToLanes_(const uint32_t capacity)
+	{
+		return (static_cast<size_t>(capacity) + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+	}
+
+	static std::unique_ptr<float[], freeStreams_> allocateStreams_(const size_t streamStride)
+	{
+		const auto numFloats = streamStride * static_cast<size_t>(Attribute::Count);
+		auto streams = static_cast<float*>(::operator new[](numFloats * sizeof(float), std::align_val_t(ALIGNMENT)));
+		std::fill_n(streams, numFloats, 0.0f);
+		return std::unique_ptr<float[], freeStreams_>(streams);
+	}
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "stdafx.h"
+
+#include <array>
+
+// Counter-based random number generator (Philox4x32-10). Every output is a pure function of the seed, a stream id and
+// an index, so there is no shared state: any number of threads can generate disjoint index ranges concurrently, and the
+// values a particle gets don't depend on how its spawn was split across frames, chunks or threads.
+class ParticleRandom
+{
+public:
+	explicit ParticleRandom(const uint64_t seed) : key_{
+		static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)
+	}
+	{
+	}
+
+	// Four random words for the given 128-bit counter, split into a 64-bit block index and a 32-bit stream id.
+	[[nodiscard]] std::array<uint32_t, 4> Generate(const uint64_t block, const uint32_t stream) const
+	{
+		std::array<uint32_t, 4> counter = {static_cast<uint32_t>(block), static_cast<uint32_t>(block >> 32), stream, 0};
+		auto key = key_;
+		for (auto round = 0; round < ROUNDS; ++round)
+		{
+			counter = round_(counter, key);
+			key[0] += WEYL_0;
+			key[1] += WEYL_1;
+		}
+		return counter;
+	}
+
+	// Fills values[0, count) with uniform floats in [min, max), for the indices [firstIndex, firstIndex + count) of the
+	// given stream. Each Philox block yields four consecutive indices.
+	void FillUniform(float* values, const uint32_t count, const uint64_t firstIndex, const uint32_t stream,
+	                 const float min, const float max) const
+	{
+		const auto range = max - min;
+		uint32_t i = 0;
+		while (i < count)
+		{
+			const auto index = firstIndex + i;
+			const auto words = Generate(index / 4, stream);
+			for (auto lane = static_cast<uint32_t>(index % 4); lane < 4 && i < count; ++lane, ++i)
+			{
+				values[i] = min + ToUnitFloat(words[lane]) * range;
+			}
+		}
+	}
+
+	// Maps the top 24 bits of a word onto [0, 1), which is exactly representable as a float.
+	static float ToUnitFloat(const uint32_t word)
+	{
+		return static_cast<float>(word >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	std::array<uint32_t, 2> key_;
+
+	static const inline int ROUNDS = 10;
+	static const inline uint32_t MULTIPLIER_0 = 0xD2511F53;
+	static const inline uint32_t MULTIPLIER_1 = 0xCD9E8D57;
+	static const inline uint32_t WEYL_0 = 0x9E3779B9;
+	static const inline uint32_t WEYL_1 = 0xBB67AE85;
+
+	static std::array<uint32_t, 4> round_(const std::array<uint32_t, 4>& counter, const std::array<uint32_t, 2>& key)
+	{
+		const auto product0 = static_cast<uint64_t>(MULTIPLIER_0) * counter[0];
+		const auto product1 = static_cast<uint64_t>(MULTIPLIER_1) * counter[2];
+		return {
+			static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key[0], static_cast<uint32_t>(product1),
+			static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key[1], static_cast<uint32_t>(product0)
+		};
+	}
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "stdafx.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+// Hands out one vk::Sampler per distinct sampler state, shared by every texture that samples with it, since drivers
+// cap how many samplers can be alive at once (maxSamplerAllocationCount). Samplers live as long as the cache.
+//
+// Samplers don't limit the level of detail by default. Which mip levels can be sampled is up to each texture's image
+// view, so textures with different mip counts still share a sampler.
+class SamplerCache
+{
+public:
+	struct State
+	{
+		vk::Filter MagFilter = vk::Filter::eLinear;
+		vk::Filter MinFilter = vk::Filter::eLinear;
+		vk::SamplerMipmapMode MipmapMode = vk::SamplerMipmapMode::eLinear;
+		vk::SamplerAddressMode AddressMode = vk::SamplerAddressMode::eRepeat;
+		// Clamped to the device's maxSamplerAnisotropy, 1 disables anisotropic filtering.
+		float MaxAnisotropy = 16.0f;
+		float MaxLod = VK_LOD_CLAMP_NONE;
+
+		bool operator<(const State& other) const
+		{
+			return std::tie(MagFilter, MinFilter, MipmapMode, AddressMode, MaxAnisotropy, MaxLod) <
+				std::tie(other.MagFilter, other.MinFilter, other.MipmapMode, other.AddressMode, other.MaxAnisotropy,
+				         other.MaxLod);
+		}
+	};
+
+	SamplerCache(const std::shared_ptr<vk::Device>& logicalDevice, const float maxSupportedAnisotropy) :
+		logicalDevice_(logicalDevice), maxSupportedAnisotropy_(maxSupportedAnisotropy)
+	{
+		DebugMessage("SamplerCache::SamplerCache(maxAnisotropy=" + std::to_string(maxSupportedAnisotropy_) + ")");
+	}
+
+	~SamplerCache()
+	{
+		DebugMessage("SamplerCache::~SamplerCache(" + std::to_string(samplers_.size()) + " samplers)");
+	}
+
+	SamplerCache(const SamplerCache&) = delete;
+	SamplerCache& operator=(const SamplerCache&) = delete;
+
+	// Returns the sampler for state, creating it on first use. Safe to call from any thread.
+	vk::Sampler Get(const State& requestedState = {})
+	{
+		auto state = requestedState;
+		state.MaxAnisotropy = std::clamp(state.MaxAnisotropy, 1.0f, maxSupportedAnisotropy_);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		const auto existing = samplers_.find(state);
+		if (existing != samplers_.end())
+		{
+			return existing->second.get();
+		}
+
+		DebugMessage("SamplerCache::Get() - creating sampler " + std::to_string(samplers_.size()));
+		const vk::SamplerCreateInfo samplerCreateInfo({}, state.MagFilter, state.MinFilter, state.MipmapMode,
+		                                              state.AddressMode, state.AddressMode, state.AddressMode, 0.0f,
+		                                              state.MaxAnisotropy > 1.0f, state.MaxAnisotropy, VK_FALSE,
+		                                              vk::CompareOp::eNever, 0.0f, state.MaxLod,
+		                                              vk::BorderColor::eIntOpaqueBlack, VK_FALSE);
+		return samplers_.emplace(state, logicalDevice_->createSamplerUnique(samplerCreateInfo)).first->second.get();
+	}
+
+	[[nodiscard]] size_t GetCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return samplers_.size();
+	}
+
+private:
+	std::shared_ptr<vk::Device> logicalDevice_;
+	float maxSupportedAnisotropy_;
+	std::mutex mutex_;
+	std::map<State, vk::UniqueSampler> samplers_;
+};
@@ -8,12 +8,16 @@
 
 #include "DescriptorSet.h"
 #include "Mesh.h"
+#include "TextureAtlas.h"
+#include "TextureLoader.h"
 #include "Transform.h"
 
 class Scene
 {
 public:
-	Scene(const uint32_t maxFramesInFlight) : maxFramesInFlight_(maxFramesInFlight)
+	// Without a textureLoader, AddTexture() loads textures synchronously.
+	Scene(const uint32_t maxFramesInFlight, const std::shared_ptr<TextureLoader>& textureLoader = nullptr) :
+		maxFramesInFlight_(maxFramesInFlight), textureLoader_(textureLoader)
 	{
 		auto cameraIndex = AddCamera();
 		SetActiveCamera(cameraIndex);
@@ -68,7 +72,7 @@ public:
 		return AddMesh(textureIndex, transformIndex, vertices, indices, vulkanContext, descriptorSetIndex);
 	}
 
-	uint32_t AddParticleEffect(const uint32_t textureIndex, const uint32_t transformIndex, const glm::vec3& position, const uint32_t numParticles, const float particleSize, std::shared_ptr<VulkanContext> vulkanContext, const uint32_t descriptorSetIndex)
+	uint32_t AddParticleEffect(const uint32_t textureIndex, const uint32_t transformIndex, const glm::vec3& position, const ParticleEmitter& emitter, const float particleSize, std::shared_ptr<VulkanContext> vulkanContext, const uint32_t descriptorSetIndex, const ParticleEffect::RenderMode renderMode = ParticleEffect::RenderMode::Instanced, const glm::vec4& uvRect = Mesh::FULL_UV_RECT)
 	{
 		DebugMessage("Scene::AddParticleEffect()");
 		// const auto transformIndex = AddTransform(glm::vec3(), glm::vec3(1.0f, 0.0f, 0.0f), glm::radians(-90.0f), glm::vec3(1.0f));
@@ -79,15 +83,19 @@ public:
 		// 	{0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex}
 		// 	});
 		// const auto descriptorSetIndex = AddDescriptorSet(descriptorSetLayoutIndex);
+		const auto computeDescriptorSetIndex = renderMode == ParticleEffect::RenderMode::Compute
+			                                       ? vulkanContext->AddComputeDescriptorSet()
+			                                       : 0;
 		const auto& particleEffect = std::make_shared<ParticleEffect>(vulkanContext->GetDeviceContext(),
 		                                                              vulkanContext->GetCommandPool(), transformIndex,
 		                                                              textureIndex, descriptorSetIndex, position,
-		                                                              numParticles, particleSize, maxFramesInFlight_);
+		                                                              emitter, particleSize, maxFramesInFlight_,
+		                                                              renderMode, computeDescriptorSetIndex, uvRect);
 		particleEffects_.emplace_back(particleEffect);
 		return particleEffects_.size() - 1;
 	}
 
-	uint32_t AddMesh(const uint32_t textureIndex, const uint32_t transformIndex, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, std::shared_ptr<VulkanContext> vulkanContext, const uint32_t descriptorSetIndex)
+	uint32_t AddMesh(const uint32_t textureIndex, const uint32_t transformIndex, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, std::shared_ptr<VulkanContext> vulkanContext, const uint32_t descriptorSetIndex, const glm::vec4& uvRect = Mesh::FULL_UV_RECT)
 	{
 		DebugMessage("Scene::AddMesh()");
 		// TODO: [zpuls 2020-08-03T23:19] Generate this dynamically based on what shader the user wants to attach to the mesh, instead of hard-coding it
@@ -97,8 +105,8 @@ public:
 		// });
 		// const auto descriptorSetIndex = AddDescriptorSet(descriptorSetLayoutIndex);
 		const auto& mesh = std::make_shared<Mesh>(vulkanContext->GetDeviceContext(), vulkanContext->GetCommandPool(),
-		                                          true, transformIndex, textureIndex, descriptorSetIndex);
-		mesh->Create(vertices, indices, maxFramesInFlight_);
+		                                          true, transformIndex, textureIndex, descriptorSetIndex, uvRect);
+		mesh->Create(vertices, indices);
 		meshes_.emplace_back(mesh);
 		return meshes_.size() - 1;
 	}
@@ -113,13 +121,62 @@ public:
 		return particleEffects_[index];
 	}
 	
+	// The returned index resolves to the TextureLoader's placeholder until the texture has been loaded, see
+	// ResolveTextures(). Cooked TextureContainer files are uploaded as-is, generateMipmaps only applies to images.
 	uint32_t AddTexture(const std::string& filename, std::shared_ptr<VulkanContext> vulkanContext)
 	{
-		textures_.emplace_back(std::make_shared<Texture>(filename, vulkanContext->GetDeviceContext(),
-		                                                 vulkanContext->GetCommandPool(), true));
+		if (textureLoader_ == nullptr && TextureContainer::IsContainer(filename))
+		{
+			textures_.emplace_back(std::make_shared<Texture>(TextureContainer(filename),
+			                                                 vulkanContext->GetDeviceContext(),
+			                                                 vulkanContext->GetCommandPool()));
+			return textures_.size() - 1;
+		}
+
+		if (textureLoader_ == nullptr)
+		{
+			textures_.emplace_back(std::make_shared<Texture>(filename, vulkanContext->GetDeviceContext(),
+			                                                 vulkanContext->GetCommandPool(), true));
+			return textures_.size() - 1;
+		}
+
+		const auto textureIndex = static_cast<uint32_t>(textures_.size());
+		textures_.emplace_back(textureLoader_->GetPlaceholder());
+		textureLoader_->Load(filename, true, [this, textureIndex](const std::shared_ptr<Texture>& texture)
+		{
+			textures_[textureIndex] = texture;
+			++textureGeneration_;
+		});
+		return textureIndex;
+	}
+
+	// Builds the atlas synchronously. Meshes and particle effects drawn from it pass atlas.GetUvRect() of their image, and
+	// can share one descriptor set.
+	uint32_t AddTextureAtlas(TextureAtlas& atlas, std::shared_ptr<VulkanContext> vulkanContext,
+	                         JobSystem* jobSystem = nullptr)
+	{
+		textures_.emplace_back(atlas.Build(vulkanContext->GetDeviceContext(), vulkanContext->GetCommandPool(),
+		                                   jobSystem));
 		return textures_.size() - 1;
 	}
 
+	// Swaps in every texture that has finished loading since the last call. Call from the render thread, before any
+	// descriptor set is written.
+	void ResolveTextures()
+	{
+		if (textureLoader_ != nullptr)
+		{
+			textureLoader_->Update();
+		}
+	}
+
+	// Changes whenever GetTexture() may return a different texture for some index, so descriptor sets that point at
+	// the old one can be rewritten.
+	[[nodiscard]] uint64_t GetTextureGeneration() const
+	{
+		return textureGeneration_;
+	}
+
 	std::shared_ptr<Texture> GetTexture(const uint32_t index)
 	{
 		return textures_[index];
@@ -139,25 +196,17 @@ public:
 
 	// TODO: [zpuls 2020-08-04T16:51] Break rendering functionality out into a separate rendering object
 
-	std::array<glm::mat4, 3> GetMVP(std::shared_ptr<Mesh> mesh)
+	glm::mat4 GetModelMatrix(std::shared_ptr<Mesh> mesh)
 	{
-		auto modelMatrix = transforms_[mesh->GetTransformIndex()]->GetModelMatrix();
-		auto viewMatrix = cameras_[activeCamera_]->GetViewMatrix();
-		DebugMessage("Scene::GetMVP() - M: " + glm::to_string(modelMatrix) + ", V: " + glm::to_string(viewMatrix) + ", P: " + glm::to_string(projectionMatrix_));
-		return {
-			modelMatrix,
-			viewMatrix,
-			projectionMatrix_
-		};
+		return transforms_[mesh->GetTransformIndex()]->GetModelMatrix();
 	}
 
-	std::array<glm::mat4, 3> GetMVP(std::shared_ptr<ParticleEffect> particleEffect)
+	// View and projection are the same for every draw, so they are computed once per frame.
+	std::array<glm::mat4, 2> GetViewProjection()
 	{
-		auto modelMatrix = transforms_[particleEffect->GetTransformIndex()]->GetModelMatrix();
 		auto viewMatrix = cameras_[activeCamera_]->GetViewMatrix();
-		DebugMessage("Scene::GetMVP() - M: " + glm::to_string(modelMatrix) + ", V: " + glm::to_string(viewMatrix) + ", P: " + glm::to_string(projectionMatrix_));
+		DebugMessage("Scene::GetViewProjection() - V: " + glm::to_string(viewMatrix) + ", P: " + glm::to_string(projectionMatrix_));
 		return {
-			modelMatrix,
 			viewMatrix,
 			projectionMatrix_
 		};
@@ -200,6 +249,8 @@ public:
 	}
 private:
 	const uint32_t maxFramesInFlight_;
+	std::shared_ptr<TextureLoader> textureLoader_;
+	uint64_t textureGeneration_ = 0;
 	// std::vector<std::shared_ptr<Buffer>> buffers_;
 	std::vector<std::shared_ptr<Mesh>> meshes_;
 	std::vector<std::shared_ptr<ParticleEffect>> particleEffects_;
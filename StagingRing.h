@@ -0,0 +1,241 @@
+#pragma once
+
+#include "stdafx.h"
+#include "Buffer.h"
+#include "TransferManager.h"
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// One large, persistently mapped host-visible buffer that every upload path sub-allocates its staging memory from,
+// instead of creating and destroying a staging Buffer per upload. Regions are handed out in ring order, and are
+// reclaimed once the TransferManager batch that copies out of them has finished executing on the GPU.
+//
+// Every region must be copied out of with one of the CopyTo() overloads, a region that never is blocks reclamation of
+// every region allocated after it.
+class StagingRing
+{
+public:
+	// What Allocate() does when the ring has no room left, even after reclaiming every completed region.
+	enum class Overflow
+	{
+		// Submits the pending uploads and blocks until the oldest region is free. Only call Allocate() from the thread
+		// that submits frames with this strategy, see TransferManager::Flush().
+		Wait,
+		// Creates a temporary staging Buffer for the region, which is freed once its copy has executed.
+		Allocate
+	};
+
+	struct Region
+	{
+		vk::Buffer Buffer;
+		vk::DeviceSize Offset = 0;
+		vk::DeviceSize Size = 0;
+		void* Data = nullptr;
+		uint64_t Id = 0;
+		std::shared_ptr<::Buffer> Fallback;
+	};
+
+	StagingRing(const VulkanDeviceContext& deviceContext, vk::UniqueCommandPool& commandPool,
+	            const vk::DeviceSize size = DEFAULT_SIZE, const Overflow overflow = Overflow::Allocate) :
+		deviceContext_(deviceContext), commandPool_(commandPool), size_(size), overflow_(overflow)
+	{
+		DebugMessage("StagingRing::StagingRing(size=" + std::to_string(size_) + ")");
+		buffer_ = std::make_shared<::Buffer>(deviceContext_, commandPool_, size_,
+		                                     vk::BufferUsageFlagBits::eTransferSrc, vk::SharingMode::eExclusive,
+		                                     vk::MemoryPropertyFlagBits::eHostVisible |
+		                                     vk::MemoryPropertyFlagBits::eHostCoherent, "StagingRing::buffer_");
+	}
+
+	~StagingRing()
+	{
+		DebugMessage("StagingRing::~StagingRing()");
+	}
+
+	StagingRing(const StagingRing&) = delete;
+	StagingRing& operator=(const StagingRing&) = delete;
+
+	// Returns size bytes of mapped staging memory, starting at a multiple of alignment. Write into Region::Data, then
+	// copy the region to its destination.
+	Region Allocate(const vk::DeviceSize size, const vk::DeviceSize alignment = DEFAULT_ALIGNMENT)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		const auto regionSize = std::max<vk::DeviceSize>(size, 1);
+		if (regionSize <= size_)
+		{
+			vk::DeviceSize offset = 0;
+			while (!tryAllocate_(regionSize, alignment, offset))
+			{
+				reclaim_();
+				if (tryAllocate_(regionSize, alignment, offset))
+				{
+					break;
+				}
+
+				if (overflow_ == Overflow::Allocate || regions_.front().Handle == 0)
+				{
+					return allocateFallback_(size);
+				}
+
+				deviceContext_.Transfers->Wait(regions_.front().Handle);
+			}
+
+			regions_.push_back({nextId_, offset, offset + regionSize, 0});
+			return {
+				buffer_->GetHandle(), offset, size, static_cast<char*>(buffer_->GetMappedData()) + offset, nextId_++
+			};
+		}
+
+		return allocateFallback_(size);
+	}
+
+	// Allocates a region, and fills it with size bytes of data.
+	Region Upload(const void* data, const vk::DeviceSize size)
+	{
+		auto region = Allocate(size);
+		memcpy(region.Data, data, static_cast<size_t>(size));
+		return region;
+	}
+
+	// Also hands the written range of the destination over to the graphics queue family, see Buffer::RecordWrite().
+	TransferManager::Handle CopyTo(const Region& region, const std::shared_ptr<::Buffer>& destination,
+	                               const vk::DeviceSize destinationOffset = 0)
+	{
+		DebugMessage("StagingRing::CopyTo(Buffer)");
+		const auto copy = [&region, &destination, destinationOffset](const vk::CommandBuffer commandBuffer)
+		{
+			commandBuffer.copyBuffer(region.Buffer, destination->GetHandle(),
+			                         vk::BufferCopy(region.Offset, destinationOffset, region.Size));
+		};
+		return destination->RecordWrite(destinationOffset, region.Size, [this, &region, &copy]
+		{
+			return record_(region, copy);
+		});
+	}
+
+	// Copies the region into mip level 0 of an image in eTransferDstOptimal layout. Callers transfer ownership of the
+	// image themselves, once they have written every subresource they upload.
+	TransferManager::Handle CopyTo(const Region& region, const vk::Image destination, const vk::Extent3D imageExtent)
+	{
+		return CopyTo(region, destination, {
+			              vk::BufferImageCopy(0, {}, {}, {vk::ImageAspectFlagBits::eColor, {}, {}, 1}, {0, 0, 0},
+			                                  imageExtent)
+		              });
+	}
+
+	// Like above, for any number of subresources. Each copy's bufferOffset is relative to the start of the region.
+	TransferManager::Handle CopyTo(const Region& region, const vk::Image destination,
+	                               std::vector<vk::BufferImageCopy> bufferImageCopies)
+	{
+		DebugMessage("StagingRing::CopyTo(vk::Image)");
+		for (auto& bufferImageCopy : bufferImageCopies)
+		{
+			bufferImageCopy.bufferOffset += region.Offset;
+		}
+		return record_(region, [&region, destination, &bufferImageCopies](const vk::CommandBuffer commandBuffer)
+		{
+			commandBuffer.copyBufferToImage(region.Buffer, destination, vk::ImageLayout::eTransferDstOptimal,
+			                                bufferImageCopies);
+		});
+	}
+
+	[[nodiscard]] vk::DeviceSize GetSize() const
+	{
+		return size_;
+	}
+
+	// Offsets satisfy optimalBufferCopyOffsetAlignment on every device, and the texel size of every format uploaded.
+	static const inline vk::DeviceSize DEFAULT_ALIGNMENT = 16;
+	static const inline vk::DeviceSize DEFAULT_SIZE = 32 * 1024 * 1024;
+
+private:
+	struct PendingRegion
+	{
+		uint64_t Id;
+		vk::DeviceSize Begin;
+		vk::DeviceSize End;
+		// The last batch that copies out of the region, 0 until the region has been copied out of.
+		TransferManager::Handle Handle;
+	};
+
+	const VulkanDeviceContext deviceContext_;
+	vk::UniqueCommandPool& commandPool_;
+	vk::DeviceSize size_;
+	Overflow overflow_;
+	std::shared_ptr<::Buffer> buffer_;
+	std::mutex mutex_;
+	std::deque<PendingRegion> regions_;
+	uint64_t nextId_ = 1;
+
+	template <typename RecordFunction>
+	TransferManager::Handle record_(const Region& region, RecordFunction&& record)
+	{
+		auto& transfers = *deviceContext_.Transfers;
+		const auto handle = transfers.Record(std::forward<RecordFunction>(record));
+		if (region.Fallback != nullptr)
+		{
+			transfers.KeepAlive(region.Fallback);
+			return handle;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!regions_.empty() && region.Id >= regions_.front().Id && region.Id <= regions_.back().Id)
+		{
+			auto& pending = regions_[static_cast<size_t>(region.Id - regions_.front().Id)];
+			pending.Handle = std::max(pending.Handle, handle);
+		}
+		return handle;
+	}
+
+	// Live regions always occupy [front.Begin, back.End), wrapping around the end of the buffer if back.End is not past
+	// front.Begin.
+	bool tryAllocate_(const vk::DeviceSize size, const vk::DeviceSize alignment, vk::DeviceSize& offset) const
+	{
+		if (regions_.empty())
+		{
+			offset = 0;
+			return true;
+		}
+
+		const auto tail = regions_.front().Begin;
+		const auto head = (regions_.back().End + alignment - 1) / alignment * alignment;
+		if (regions_.back().End > tail)
+		{
+			if (head + size <= size_)
+			{
+				offset = head;
+				return true;
+			}
+
+			offset = 0;
+			return size <= tail;
+		}
+
+		offset = head;
+		return head + size <= tail;
+	}
+
+	void reclaim_()
+	{
+		while (!regions_.empty() && regions_.front().Handle != 0 &&
+			deviceContext_.Transfers->IsComplete(regions_.front().Handle))
+		{
+			regions_.pop_front();
+		}
+	}
+
+	Region allocateFallback_(const vk::DeviceSize size) const
+	{
+		DebugMessage("StagingRing::allocateFallback_(size=" + std::to_string(size) + ")");
+		auto fallback = std::make_shared<::Buffer>(deviceContext_, commandPool_, std::max<vk::DeviceSize>(size, 1),
+		                                           vk::BufferUsageFlagBits::eTransferSrc,
+		                                           vk::SharingMode::eExclusive,
+		                                           vk::MemoryPropertyFlagBits::eHostVisible |
+		                                           vk::MemoryPropertyFlagBits::eHostCoherent,
+		                                           "StagingRing::fallbackBuffer");
+		return {fallback->GetHandle(), 0, size, fallback->GetMappedData(), 0, fallback};
+	}
+};
@@ -3,126 +3,122 @@
 #include "stdafx.h"
 #include <memory>
 #include "Image.h"
+#include "MipGenerator.h"
+#include "SamplerCache.h"
+#include "StagingRing.h"
+#include "TextureContainer.h"
 #include "VulkanDeviceContext.h"
 
 class Texture : public Image
 {
 public:
+	// Decoded RGBA8 pixels, tightly packed.
+	struct Pixels
+	{
+		std::shared_ptr<const unsigned char> Data;
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+	};
+
 	Texture(const std::string& filename, const VulkanDeviceContext& deviceContext,
 	        vk::UniqueCommandPool& commandPool, const bool generateMipmaps) :
-		Image(deviceContext, commandPool, getImageDimensions_(filename, generateMipmaps),
+		Texture(Decode(filename), deviceContext, commandPool, generateMipmaps)
+	{
+	}
+
+	// Only the upload touches the pixels, they can be freed as soon as this returns. On devices that can't blit the format,
+	// the mip chain is built on the CPU instead, split across jobSystem's threads if there is one.
+	Texture(const Pixels& pixels, const VulkanDeviceContext& deviceContext, vk::UniqueCommandPool& commandPool,
+	        const bool generateMipmaps, JobSystem* jobSystem = nullptr) :
+		Image(deviceContext, commandPool, getImageDimensions_(pixels, generateMipmaps),
 		      vk::Format::eR8G8B8A8Unorm,
 		      vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::
 		      eTransferDst | vk::ImageUsageFlagBits::eSampled,
 		      vk::MemoryPropertyFlagBits::eDeviceLocal)
 	{
 		DebugMessage("Texture::Texture()");
-		int width, height, numChannels;
-		imagePixels_.reset(stbi_load(filename.c_str(), &width, &height, &numChannels, STBI_rgb_alpha));
-		const auto imageSize = static_cast<vk::DeviceSize>(width) * static_cast<vk::DeviceSize>(height) * 4L;
-		auto stagingBuffer = std::make_shared<PixelBuffer>(deviceContext_, commandPool_, imageSize,
-		                                                   vk::BufferUsageFlagBits::eTransferSrc,
-		                                                   vk::SharingMode::eExclusive,
-		                                                   vk::MemoryPropertyFlagBits::eHostVisible |
-		                                                   vk::MemoryPropertyFlagBits::eHostCoherent, "Texture::stagingBuffer");
-		stagingBuffer->Fill(0, imageSize, &imagePixels_.get()[0]);
-
-		TransitionLayout(vk::Format::eR8G8B8A8Unorm,
-		                 vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
-		                 {}, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTopOfPipe,
-		                 vk::PipelineStageFlagBits::eTransfer, vk::ImageAspectFlagBits::eColor);
-		stagingBuffer->CopyTo(imageHandle_, vk::Extent3D{
-			                      static_cast<uint32_t>(width_), static_cast<uint32_t>(height_), 1
-		                      });
-
-		auto commandBuffers = deviceContext_.LogicalDevice->allocateCommandBuffersUnique({ commandPool_.get(), {}, 1 });
-		auto& commandBuffer = commandBuffers[0];
-		commandBuffer->begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-		
-		vk::ImageMemoryBarrier imageMemoryBarrier({}, {}, {}, {}, {}, {}, imageHandle_.get(),
-		                                          {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
-
-		if (generateMipmaps)
+		if (mipLevels_ > 1 && !supportsBlitMipmaps_())
+		{
+			uploadLevels_(MipGenerator::Generate(pixels.Data.get(), width_, height_, mipLevels_,
+			                                     MipGenerator::Filter::Kaiser, true, jobSystem));
+		}
+		else
 		{
-			auto mipWidth = width_;
-			auto mipHeight = height_;
+			const auto imageSize = static_cast<vk::DeviceSize>(width_) * static_cast<vk::DeviceSize>(height_) * 4L;
+			auto& staging = *deviceContext_.Staging;
+			const auto stagingRegion = staging.Upload(pixels.Data.get(), imageSize);
+
+			// Everything below is recorded into the open TransferManager batch, so every texture created before the next
+			// TransferManager::Flush() is uploaded in the same submission.
+			TransitionLayout(vk::Format::eR8G8B8A8Unorm,
+			                 vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+			                 {}, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTopOfPipe,
+			                 vk::PipelineStageFlagBits::eTransfer, vk::ImageAspectFlagBits::eColor,
+			                 TransferManager::Queue::Transfer);
+			staging.CopyTo(stagingRegion, imageHandle_.get(), vk::Extent3D{
+				               static_cast<uint32_t>(width_), static_cast<uint32_t>(height_), 1
+			               });
+			deviceContext_.Transfers->TransferOwnership(imageHandle_.get(),
+			                                            {vk::ImageAspectFlagBits::eColor, 0, mipLevels_, 0, 1},
+			                                            vk::ImageLayout::eTransferDstOptimal);
 
-			for (uint32_t i = 1; i < mipLevels_; i++)
+			// Blits and transitions to shader stages need a graphics queue.
+			deviceContext_.Transfers->Record([this](const vk::CommandBuffer commandBuffer)
 			{
-				imageMemoryBarrier.subresourceRange.baseMipLevel = i - 1;
-				imageMemoryBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-				imageMemoryBarrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-				imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-				imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-
-				commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-				                              vk::PipelineStageFlagBits::eTransfer,
-				                              {}, {}, {}, {imageMemoryBarrier});
-
-				vk::ImageBlit imageBlit({vk::ImageAspectFlagBits::eColor, i - 1, 0, 1},
-				                        std::array<vk::Offset3D, 2>{
-					                        vk::Offset3D(0, 0, 0), vk::Offset3D(mipWidth, mipHeight, 1)
-				                        }, {
-					                        vk::ImageAspectFlagBits::eColor, i, 0, 1
-				                        }, std::array<vk::Offset3D, 2>{
-					                        vk::Offset3D(0, 0, 0),
-					                        vk::Offset3D(
-						                        mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1
-					                        )
-				                        });
-
-				commandBuffer->blitImage(imageHandle_.get(), vk::ImageLayout::eTransferSrcOptimal, imageHandle_.get(),
-				                        vk::ImageLayout::eTransferDstOptimal, 1, &imageBlit, vk::Filter::eLinear);
-
-				imageMemoryBarrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
-				imageMemoryBarrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-				imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
-				imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-				commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-				                              vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {},
-				                              {imageMemoryBarrier});
-
-				if (mipWidth > 1)
-				{
-					mipWidth /= 2;
-				}
-
-				if (mipHeight > 1)
-				{
-					mipHeight /= 2;
-				}
-			}
+				recordMipmapGeneration_(commandBuffer);
+			}, TransferManager::Queue::Graphics);
+		}
+		
+		CreateImageView(vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor);
 
-			imageMemoryBarrier.subresourceRange.baseMipLevel = mipLevels_ - 1;
-			imageMemoryBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-			imageMemoryBarrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-			imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-			imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+		createSampler_();
+	}
 
-			commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-			                              vk::PipelineStageFlagBits::eFragmentShader,
-			                              {}, {}, {}, {imageMemoryBarrier});
+	// Uploads every level of a cooked container as-is, so there is nothing to decode or blit, see TextureContainer. Throws
+	// if the device can't sample the container's format, e.g. a BC format without textureCompressionBC.
+	Texture(const TextureContainer& container, const VulkanDeviceContext& deviceContext,
+	        vk::UniqueCommandPool& commandPool) :
+		Image(deviceContext, commandPool, {
+			      container.GetHeader().Width, container.GetHeader().Height, container.GetHeader().MipLevels
+		      }, Util::FindSupportedFormat(deviceContext, {container.GetFormat()}, vk::ImageTiling::eOptimal,
+		                                   vk::FormatFeatureFlagBits::eSampledImage |
+		                                   vk::FormatFeatureFlagBits::eSampledImageFilterLinear),
+		      vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+		      vk::MemoryPropertyFlagBits::eDeviceLocal)
+	{
+		DebugMessage("Texture::Texture(TextureContainer)");
+		auto& staging = *deviceContext_.Staging;
+		const auto stagingRegion = staging.Allocate(container.GetHeader().DataSize, TextureContainer::DATA_ALIGNMENT);
+		container.Read(stagingRegion.Data);
 
-			commandBuffer->end();
-			vk::SubmitInfo submitInfo({}, {}, {}, 1, &commandBuffer.get());
-			deviceContext_.GraphicsQueue->submit(1, &submitInfo, nullptr);
-			deviceContext_.GraphicsQueue->waitIdle();
+		std::vector<vk::BufferImageCopy> bufferImageCopies;
+		for (uint32_t i = 0; i < mipLevels_; ++i)
+		{
+			const auto& level = container.GetLevels()[i];
+			bufferImageCopies.emplace_back(level.Offset, 0, 0, vk::ImageSubresourceLayers(
+				                               vk::ImageAspectFlagBits::eColor, i, 0, 1), vk::Offset3D(0, 0, 0),
+			                               vk::Extent3D(level.Width, level.Height, 1));
 		}
-		
-		CreateImageView(vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor);
 
-		TransitionLayout(vk::Format::eR8G8B8A8Unorm,
-		                 vk::ImageLayout::eUndefined,
-		                 vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eTransferWrite,
-		                 vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eTransfer,
-		                 vk::PipelineStageFlagBits::eFragmentShader, vk::ImageAspectFlagBits::eColor);
-
-		vk::SamplerCreateInfo samplerCreateInfo({}, vk::Filter::eLinear, vk::Filter::eLinear,
-		                                        vk::SamplerMipmapMode::eLinear, {}, {}, {}, {}, VK_TRUE, 16.0f, {}, {},
-		                                        {}, static_cast<float>(mipLevels_), vk::BorderColor::eIntOpaqueBlack,
-		                                        {});
-		samplerHandle_ = deviceContext_.LogicalDevice->createSamplerUnique(samplerCreateInfo);
+		uploadLevels_(stagingRegion, bufferImageCopies);
+
+		CreateImageView(format_, vk::ImageAspectFlagBits::eColor);
+		createSampler_();
+	}
+
+	// Uploads a mip chain already built on the CPU, e.g. by TextureAtlas, largest level first.
+	Texture(const std::vector<MipGenerator::Level>& levels, const VulkanDeviceContext& deviceContext,
+	        vk::UniqueCommandPool& commandPool) :
+		Image(deviceContext, commandPool, {
+			      levels.front().Width, levels.front().Height, static_cast<uint32_t>(levels.size())
+		      }, vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+		      vk::MemoryPropertyFlagBits::eDeviceLocal)
+	{
+		DebugMessage("Texture::Texture(levels)");
+		uploadLevels_(levels);
+
+		CreateImageView(format_, vk::ImageAspectFlagBits::eColor);
+		createSampler_();
 	}
 
 	~Texture()
@@ -130,32 +126,172 @@ public:
 		DebugMessage("Texture::~Texture()");
 	}
 
+	// Reads and decodes an image file. Touches no Vulkan state, so it is safe to call from any thread.
+	static Pixels Decode(const std::string& filename)
+	{
+		int width, height, numChannels;
+		const auto data = stbi_load(filename.c_str(), &width, &height, &numChannels, STBI_rgb_alpha);
+		if (data == nullptr)
+		{
+			throw std::runtime_error("Could not load texture [" + filename + "]: " + stbi_failure_reason());
+		}
+		return {
+			std::shared_ptr<const unsigned char>(data, [](const unsigned char* ptr)
+			{
+				stbi_image_free(const_cast<unsigned char*>(ptr));
+			}),
+			static_cast<uint32_t>(width), static_cast<uint32_t>(height)
+		};
+	}
+
+	// Levels in a full mip chain, down to 1x1.
+	static uint32_t GetMipLevels(const uint32_t width, const uint32_t height)
+	{
+		return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+	}
+
 	vk::DescriptorImageInfo GenerateDescriptorImageInfo() const
 	{
 		return {
-			samplerHandle_.get(), imageView_.get(), vk::ImageLayout::eShaderReadOnlyOptimal
+			samplerHandle_, imageView_.get(), vk::ImageLayout::eShaderReadOnlyOptimal
 		};
 	}
 
 private:
-	vk::UniqueSampler samplerHandle_;
+	// Owned by the device's SamplerCache, which deviceContext_ keeps alive.
+	vk::Sampler samplerHandle_;
+
+	// Every texture samples with the same state, so they all share one sampler.
+	void createSampler_()
+	{
+		samplerHandle_ = deviceContext_.Samplers->Get();
+	}
 
-	struct freeImage_
+	[[nodiscard]] bool supportsBlitMipmaps_() const
 	{
-		void operator()(unsigned char* ptr) const
+		const auto requiredFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst |
+			vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+		const auto formatProperties = deviceContext_.PhysicalDevice->getFormatProperties(format_);
+		return (formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures;
+	}
+
+	// Packs levels into one staging region, see uploadLevels_() below.
+	void uploadLevels_(const std::vector<MipGenerator::Level>& levels)
+	{
+		std::vector<vk::BufferImageCopy> bufferImageCopies;
+		vk::DeviceSize size = 0;
+		for (uint32_t i = 0; i < levels.size(); ++i)
 		{
-			stbi_image_free(ptr);
+			size = (size + StagingRing::DEFAULT_ALIGNMENT - 1) / StagingRing::DEFAULT_ALIGNMENT *
+				StagingRing::DEFAULT_ALIGNMENT;
+			bufferImageCopies.emplace_back(size, 0, 0, vk::ImageSubresourceLayers(
+				                               vk::ImageAspectFlagBits::eColor, i, 0, 1), vk::Offset3D(0, 0, 0),
+			                               vk::Extent3D(levels[i].Width, levels[i].Height, 1));
+			size += levels[i].Pixels.size();
 		}
-	};
 
-	std::unique_ptr<unsigned char, freeImage_> imagePixels_;
+		const auto stagingRegion = deviceContext_.Staging->Allocate(size);
+		for (uint32_t i = 0; i < levels.size(); ++i)
+		{
+			memcpy(static_cast<char*>(stagingRegion.Data) + bufferImageCopies[i].bufferOffset, levels[i].Pixels.data(),
+			       levels[i].Pixels.size());
+		}
+		uploadLevels_(stagingRegion, bufferImageCopies);
+	}
+
+	// Copies every level from stagingRegion at once, and transitions the whole image to eShaderReadOnlyOptimal.
+	void uploadLevels_(const StagingRing::Region& stagingRegion,
+	                   const std::vector<vk::BufferImageCopy>& bufferImageCopies)
+	{
+		TransitionLayout(format_, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, {},
+		                 vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTopOfPipe,
+		                 vk::PipelineStageFlagBits::eTransfer, vk::ImageAspectFlagBits::eColor,
+		                 TransferManager::Queue::Transfer);
+		deviceContext_.Staging->CopyTo(stagingRegion, imageHandle_.get(), bufferImageCopies);
+		deviceContext_.Transfers->TransferOwnership(imageHandle_.get(),
+		                                            {vk::ImageAspectFlagBits::eColor, 0, mipLevels_, 0, 1},
+		                                            vk::ImageLayout::eTransferDstOptimal);
+		TransitionLayout(format_, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+		                 vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead,
+		                 vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+		                 vk::ImageAspectFlagBits::eColor);
+	}
 
-	const std::array<uint32_t, 3> getImageDimensions_(const std::string& filename, bool generateMipmaps)
+	// Each mip level is blitted from the previous one, and transitioned to eShaderReadOnlyOptimal once it has been read.
+	// Without mipmaps this only transitions level 0.
+	void recordMipmapGeneration_(const vk::CommandBuffer commandBuffer) const
 	{
-		int width, height, numChannels;
-		stbi_info(filename.c_str(), &width, &height, &numChannels);
+		vk::ImageMemoryBarrier imageMemoryBarrier({}, {}, {}, {}, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+		                                          imageHandle_.get(),
+		                                          {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
+
+		auto mipWidth = width_;
+		auto mipHeight = height_;
+
+		for (uint32_t i = 1; i < mipLevels_; i++)
+		{
+			imageMemoryBarrier.subresourceRange.baseMipLevel = i - 1;
+			imageMemoryBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+			imageMemoryBarrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+			imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+			imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+			                              vk::PipelineStageFlagBits::eTransfer,
+			                              {}, {}, {}, {imageMemoryBarrier});
+
+			vk::ImageBlit imageBlit({vk::ImageAspectFlagBits::eColor, i - 1, 0, 1},
+			                        std::array<vk::Offset3D, 2>{
+				                        vk::Offset3D(0, 0, 0), vk::Offset3D(mipWidth, mipHeight, 1)
+			                        }, {
+				                        vk::ImageAspectFlagBits::eColor, i, 0, 1
+			                        }, std::array<vk::Offset3D, 2>{
+				                        vk::Offset3D(0, 0, 0),
+				                        vk::Offset3D(
+					                        mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1
+				                        )
+			                        });
+
+			commandBuffer.blitImage(imageHandle_.get(), vk::ImageLayout::eTransferSrcOptimal, imageHandle_.get(),
+			                        vk::ImageLayout::eTransferDstOptimal, 1, &imageBlit, vk::Filter::eLinear);
+
+			imageMemoryBarrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+			imageMemoryBarrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+			imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+			imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+			                              vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {},
+			                              {imageMemoryBarrier});
+
+			if (mipWidth > 1)
+			{
+				mipWidth /= 2;
+			}
+
+			if (mipHeight > 1)
+			{
+				mipHeight /= 2;
+			}
+		}
+
+		imageMemoryBarrier.subresourceRange.baseMipLevel = mipLevels_ - 1;
+		imageMemoryBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+		imageMemoryBarrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+		imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+		                              vk::PipelineStageFlagBits::eFragmentShader,
+		                              {}, {}, {}, {imageMemoryBarrier});
+	}
+
+	static std::array<uint32_t, 3> getImageDimensions_(const Pixels& pixels, bool generateMipmaps)
+	{
+		const auto width = pixels.Width;
+		const auto height = pixels.Height;
 		return {
-			static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+			width, height,
 			generateMipmaps ? 
 			        static_cast<uint32_t>(std::floor(std::log2(std::max(static_cast<uint32_t>(width), static_cast<uint32_t>(height))))) + 1 : 1
 			/*                                                                                             /\                                   /\
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "stdafx.h"
+#include "JobSystem.h"
+#include "MipGenerator.h"
+#include "Texture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+// Packs many small RGBA8 images, e.g. particle sprites, into a single Texture, so draws that use different images can
+// share one descriptor set. Each image is addressed by its UV rect, which meshes and particle effects remap their
+// texture coordinates into, see Mesh.
+//
+// Images are packed into shelves, each in a slot with padding texels on every side that repeat the image's edges, so
+// filtering at the border of a rect never reads a neighbour. Mip levels are filtered per image rather than across the
+// whole atlas, and slots are aligned so that every level keeps at least one texel of padding, which caps the atlas at
+// log2(padding) + 1 levels.
+class TextureAtlas
+{
+public:
+	explicit TextureAtlas(const uint32_t padding = DEFAULT_PADDING) : padding_(std::max(padding, 1U))
+	{
+		mipLevels_ = static_cast<uint32_t>(std::floor(std::log2(padding_))) + 1;
+		alignment_ = 1U << (mipLevels_ - 1);
+	}
+
+	// Returns the image's index, for GetUvRect().
+	uint32_t Add(const Texture::Pixels& pixels)
+	{
+		images_.push_back(pixels);
+		return static_cast<uint32_t>(images_.size() - 1);
+	}
+
+	uint32_t Add(const std::string& filename)
+	{
+		return Add(Texture::Decode(filename));
+	}
+
+	// Packs every image added so far and uploads the atlas, filtering the images' mip levels on jobSystem if there is
+	// one. GetUvRect() is only valid once this has returned.
+	std::shared_ptr<Texture> Build(const VulkanDeviceContext& deviceContext, vk::UniqueCommandPool& commandPool,
+	                               JobSystem* jobSystem = nullptr)
+	{
+		DebugMessage("TextureAtlas::Build(" + std::to_string(images_.size()) + " images)");
+		if (images_.empty())
+		{
+			throw std::runtime_error("Could not build texture atlas, no images were added.");
+		}
+
+		pack_();
+		const auto maxDimension = deviceContext.PhysicalDevice->getProperties().limits.maxImageDimension2D;
+		if (width_ > maxDimension || height_ > maxDimension)
+		{
+			throw std::runtime_error("Could not build texture atlas, [" + std::to_string(width_) + "x" +
+				std::to_string(height_) + "] exceeds the device's maximum image dimension [" +
+				std::to_string(maxDimension) + "].");
+		}
+
+		return std::make_shared<Texture>(buildLevels_(jobSystem), deviceContext, commandPool);
+	}
+
+	// Offset of the image's rect in xy, and its size in zw, both in normalized atlas coordinates.
+	[[nodiscard]] glm::vec4 GetUvRect(const uint32_t index) const
+	{
+		const auto& slot = slots_[index];
+		return {
+			static_cast<float>(slot.X + padding_) / static_cast<float>(width_),
+			static_cast<float>(slot.Y + padding_) / static_cast<float>(height_),
+			static_cast<float>(images_[index].Width) / static_cast<float>(width_),
+			static_cast<float>(images_[index].Height) / static_cast<float>(height_)
+		};
+	}
+
+	[[nodiscard]] uint32_t GetWidth() const
+	{
+		return width_;
+	}
+
+	[[nodiscard]] uint32_t GetHeight() const
+	{
+		return height_;
+	}
+
+	static const inline uint32_t DEFAULT_PADDING = 4;
+
+private:
+	// An image's rect in the atlas, padding included, in level 0 texels.
+	struct Slot
+	{
+		uint32_t X = 0;
+		uint32_t Y = 0;
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+	};
+
+	uint32_t padding_;
+	uint32_t mipLevels_;
+	// Slots are positioned and sized in multiples of this, so they halve exactly down to the last level.
+	uint32_t alignment_;
+	std::vector<Texture::Pixels> images_;
+	std::vector<Slot> slots_;
+	uint32_t width_ = 0;
+	uint32_t height_ = 0;
+
+	uint32_t align_(const uint32_t value) const
+	{
+		return (value + alignment_ - 1) / alignment_ * alignment_;
+	}
+
+	// Shelf packing, tallest slots first. The atlas is a power of two wide, about as wide as it is tall.
+	void pack_()
+	{
+		slots_.assign(images_.size(), {});
+		uint64_t area = 0;
+		uint32_t maxSlotWidth = 0;
+		for (size_t i = 0; i < images_.size(); ++i)
+		{
+			slots_[i].Width = align_(images_[i].Width + padding_ * 2);
+			slots_[i].Height = align_(images_[i].Height + padding_ * 2);
+			area += static_cast<uint64_t>(slots_[i].Width) * slots_[i].Height;
+			maxSlotWidth = std::max(maxSlotWidth, slots_[i].Width);
+		}
+
+		width_ = 1;
+		while (width_ < maxSlotWidth || static_cast<uint64_t>(width_) * width_ < area)
+		{
+			width_ *= 2;
+		}
+
+		std::vector<size_t> order(images_.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [this](const size_t a, const size_t b)
+		{
+			return slots_[a].Height > slots_[b].Height;
+		});
+
+		uint32_t x = 0;
+		uint32_t shelfY = 0;
+		uint32_t shelfHeight = 0;
+		for (const auto i : order)
+		{
+			if (x + slots_[i].Width > width_)
+			{
+				x = 0;
+				shelfY += shelfHeight;
+				shelfHeight = 0;
+			}
+
+			slots_[i].X = x;
+			slots_[i].Y = shelfY;
+			x += slots_[i].Width;
+			shelfHeight = std::max(shelfHeight, slots_[i].Height);
+		}
+		height_ = shelfY + shelfHeight;
+	}
+
+	// Every level of every image is copied into its slot, with the image's edges repeated over the slot's padding.
+	std::vector<MipGenerator::Level> buildLevels_(JobSystem* jobSystem) const
+	{
+		std::vector<MipGenerator::Level> levels(mipLevels_);
+		for (uint32_t i = 0; i < mipLevels_; ++i)
+		{
+			levels[i].Width = width_ >> i;
+			levels[i].Height = height_ >> i;
+			levels[i].Pixels.resize(static_cast<size_t>(levels[i].Width) * levels[i].Height * 4);
+		}
+
+		// Slots don't overlap, so each image can be filtered and written by its own job.
+		const auto writeImages = [this, &levels](const uint32_t begin, const uint32_t end)
+		{
+			for (auto image = begin; image < end; ++image)
+			{
+				const auto imageLevels = MipGenerator::Generate(images_[image].Data.get(), images_[image].Width,
+				                                                images_[image].Height, mipLevels_);
+				for (uint32_t i = 0; i < mipLevels_; ++i)
+				{
+					writeSlot_(slots_[image], i, imageLevels[i], levels[i]);
+				}
+			}
+		};
+
+		if (jobSystem == nullptr)
+		{
+			writeImages(0, static_cast<uint32_t>(images_.size()));
+			return levels;
+		}
+
+		JobSystem::Counter counter;
+		jobSystem->ParallelFor(0, static_cast<uint32_t>(images_.size()), 1, writeImages, counter);
+		jobSystem->Wait(counter);
+		return levels;
+	}
+
+	void writeSlot_(const Slot& slot, const uint32_t mipLevel, const MipGenerator::Level& image,
+	                MipGenerator::Level& level) const
+	{
+		const auto slotX = slot.X >> mipLevel;
+		const auto slotY = slot.Y >> mipLevel;
+		const auto padding = padding_ >> mipLevel;
+		for (uint32_t y = 0; y < slot.Height >> mipLevel; ++y)
+		{
+			const auto imageY = std::min(static_cast<uint32_t>(std::max(static_cast<int64_t>(y) - padding, int64_t{0})),
+			                             image.Height - 1);
+			for (uint32_t x = 0; x < slot.Width >> mipLevel; ++x)
+			{
+				const auto imageX = std::min(
+					static_cast<uint32_t>(std::max(static_cast<int64_t>(x) - padding, int64_t{0})), image.Width - 1);
+				std::copy_n(&image.Pixels[(static_cast<size_t>(imageY) * image.Width + imageX) * 4], 4,
+				            &level.Pixels[(static_cast<size_t>(slotY + y) * level.Width + slotX + x) * 4]);
+			}
+		}
+	}
+};
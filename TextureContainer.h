@@ -0,0 +1,269 @@
+#pragma once
+
+#include "stdafx.h"
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// Binary texture container written offline by TextureCooker, holding every mip level already in the format the image is
+// created with, so loading one is a file read straight into staging memory, with no decoding or mip generation.
+//
+// Layout (little-endian): a Header, Header::MipLevels Level entries, then the texel data of every level, largest first.
+// Level offsets are relative to the start of the texel data, and aligned to DATA_ALIGNMENT, so the data can be copied
+// into a staging region as a whole, and every level can be copied to the image from its offset.
+class TextureContainer
+{
+public:
+	struct Header
+	{
+		uint32_t Magic = MAGIC;
+		uint32_t Version = VERSION;
+		// A vk::Format.
+		uint32_t Format = 0;
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		uint32_t MipLevels = 0;
+		uint64_t DataSize = 0;
+	};
+
+	struct Level
+	{
+		uint64_t Offset = 0;
+		uint64_t Size = 0;
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+	};
+
+	// Reads the header and level table. The texel data is only read by Load() or Read().
+	explicit TextureContainer(const std::string& filename) : filename_(filename)
+	{
+		DebugMessage("TextureContainer::TextureContainer(" + filename_ + ")");
+		std::ifstream file(filename_, std::ios::binary);
+		if (!file.read(reinterpret_cast<char*>(&header_), sizeof(header_)))
+		{
+			throw std::runtime_error("Could not read texture container header from [" + filename_ + "].");
+		}
+
+		if (header_.Magic != MAGIC || header_.Version != VERSION)
+		{
+			throw std::runtime_error("Could not load texture container [" + filename_ + "], unsupported magic [" +
+				std::to_string(header_.Magic) + "] or version [" + std::to_string(header_.Version) + "].");
+		}
+
+		if (!isSupported_(GetFormat()))
+		{
+			throw std::runtime_error("Could not load texture container [" + filename_ + "], unsupported format [" +
+				vk::to_string(GetFormat()) + "].");
+		}
+
+		// Bounds MipLevels before it sizes the level table, so a corrupt header can't request an unbounded allocation.
+		if (header_.Width == 0 || header_.Height == 0 || header_.MipLevels == 0 ||
+			header_.MipLevels > maxMipLevels_(header_.Width, header_.Height))
+		{
+			throw std::runtime_error("Could not load texture container [" + filename_ + "], invalid extent [" +
+				std::to_string(header_.Width) + "x" + std::to_string(header_.Height) + "] or mip levels [" +
+				std::to_string(header_.MipLevels) + "].");
+		}
+
+		levels_.resize(header_.MipLevels);
+		if (!file.read(reinterpret_cast<char*>(levels_.data()),
+		               static_cast<std::streamsize>(levels_.size() * sizeof(Level))))
+		{
+			throw std::runtime_error("Could not read texture container levels from [" + filename_ + "].");
+		}
+
+		// Load() allocates DataSize bytes, so it is checked against the file before anything trusts it.
+		file.seekg(0, std::ios::end);
+		const auto fileSize = static_cast<uint64_t>(file.tellg());
+		const auto dataOffset = dataOffset_(header_.MipLevels);
+		if (fileSize < dataOffset || header_.DataSize > fileSize - dataOffset)
+		{
+			throw std::runtime_error("Could not load texture container [" + filename_ + "], data size [" +
+				std::to_string(header_.DataSize) + "] exceeds the file.");
+		}
+
+		for (uint32_t i = 0; i < header_.MipLevels; ++i)
+		{
+			const auto& level = levels_[i];
+			if (level.Offset % DATA_ALIGNMENT != 0 || level.Offset > header_.DataSize ||
+				level.Size > header_.DataSize - level.Offset)
+			{
+				throw std::runtime_error("Could not load texture container [" + filename_ + "], level [" +
+					std::to_string(i) + "] at offset [" + std::to_string(level.Offset) + "] with size [" +
+					std::to_string(level.Size) + "] is outside of its data.");
+			}
+
+			if (level.Width != std::max(header_.Width >> i, 1u) || level.Height != std::max(header_.Height >> i, 1u))
+			{
+				throw std::runtime_error("Could not load texture container [" + filename_ + "], level [" +
+					std::to_string(i) + "] extent [" + std::to_string(level.Width) + "x" +
+					std::to_string(level.Height) + "] doesn't match its mip chain.");
+			}
+
+			// Texture copies each level to the image as a whole, so it has to hold exactly the level's texels.
+			if (level.Size != levelSize_(GetFormat(), level.Width, level.Height))
+			{
+				throw std::runtime_error("Could not load texture container [" + filename_ + "], level [" +
+					std::to_string(i) + "] size [" + std::to_string(level.Size) + "] doesn't match its extent [" +
+					std::to_string(level.Width) + "x" + std::to_string(level.Height) + "] in format [" +
+					vk::to_string(GetFormat()) + "].");
+			}
+		}
+	}
+
+	// Reads the texel data into memory, so a later Read() doesn't touch the file. Lets a worker thread do the file IO.
+	void Load()
+	{
+		std::shared_ptr<char> data(new char[static_cast<size_t>(header_.DataSize)], std::default_delete<char[]>());
+		readData_(data.get());
+		data_ = std::move(data);
+	}
+
+	// Copies the texel data, Header::DataSize bytes, to destination, e.g. a mapped staging region.
+	void Read(void* destination) const
+	{
+		if (data_ != nullptr)
+		{
+			memcpy(destination, data_.get(), static_cast<size_t>(header_.DataSize));
+			return;
+		}
+
+		readData_(destination);
+	}
+
+	static void Write(const std::string& filename, const vk::Format format,
+	                  const std::vector<std::vector<unsigned char>>& levelData,
+	                  const std::vector<vk::Extent2D>& levelExtents)
+	{
+		DebugMessage("TextureContainer::Write(" + filename + ")");
+		if (levelData.empty() || levelData.size() != levelExtents.size())
+		{
+			throw std::runtime_error("Could not write texture container [" + filename + "], got [" +
+				std::to_string(levelData.size()) + "] levels with [" + std::to_string(levelExtents.size()) +
+				"] extents.");
+		}
+
+		Header header;
+		header.Format = static_cast<uint32_t>(format);
+		header.Width = levelExtents.front().width;
+		header.Height = levelExtents.front().height;
+		header.MipLevels = static_cast<uint32_t>(levelData.size());
+
+		std::vector<Level> levels;
+		for (size_t i = 0; i < levelData.size(); ++i)
+		{
+			header.DataSize = align_(header.DataSize);
+			levels.push_back({header.DataSize, levelData[i].size(), levelExtents[i].width, levelExtents[i].height});
+			header.DataSize += levelData[i].size();
+		}
+
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(levels.data()),
+		           static_cast<std::streamsize>(levels.size() * sizeof(Level)));
+		for (size_t i = 0; i < levelData.size(); ++i)
+		{
+			writePadding_(file, dataOffset_(header.MipLevels) + levels[i].Offset);
+			file.write(reinterpret_cast<const char*>(levelData[i].data()),
+			           static_cast<std::streamsize>(levelData[i].size()));
+		}
+
+		if (!file)
+		{
+			throw std::runtime_error("Could not write texture container [" + filename + "].");
+		}
+	}
+
+	static bool IsContainer(const std::string& filename)
+	{
+		return filename.size() >= EXTENSION.size() &&
+			filename.compare(filename.size() - EXTENSION.size(), EXTENSION.size(), EXTENSION) == 0;
+	}
+
+	[[nodiscard]] const Header& GetHeader() const
+	{
+		return header_;
+	}
+
+	[[nodiscard]] const std::vector<Level>& GetLevels() const
+	{
+		return levels_;
+	}
+
+	[[nodiscard]] vk::Format GetFormat() const
+	{
+		return static_cast<vk::Format>(header_.Format);
+	}
+
+	static const inline std::string EXTENSION = ".vptx";
+	// A multiple of every texel block size, and of optimalBufferCopyOffsetAlignment on every device.
+	static const inline uint64_t DATA_ALIGNMENT = 16;
+
+private:
+	static const inline uint32_t MAGIC = 0x58545056; // "VPTX"
+	static const inline uint32_t VERSION = 1;
+
+	std::string filename_;
+	Header header_;
+	std::vector<Level> levels_;
+	std::shared_ptr<char> data_;
+
+	// The length of the full mip chain of a width x height image.
+	static uint32_t maxMipLevels_(const uint32_t width, const uint32_t height)
+	{
+		uint32_t mipLevels = 1;
+		for (auto extent = std::max(width, height); extent > 1; extent >>= 1)
+		{
+			++mipLevels;
+		}
+		return mipLevels;
+	}
+
+	// The formats TextureCooker writes.
+	static bool isSupported_(const vk::Format format)
+	{
+		return format == vk::Format::eR8G8B8A8Unorm || BlockCompression::IsSupported(format);
+	}
+
+	static uint64_t levelSize_(const vk::Format format, const uint32_t width, const uint32_t height)
+	{
+		if (format == vk::Format::eR8G8B8A8Unorm)
+		{
+			return static_cast<uint64_t>(width) * height * 4;
+		}
+
+		// Block-compressed levels round their extent up to whole 4x4 blocks.
+		return (static_cast<uint64_t>(width) + 3) / 4 * ((static_cast<uint64_t>(height) + 3) / 4) *
+			BlockCompression::GetBlockSize(format);
+	}
+
+	static uint64_t align_(const uint64_t offset)
+	{
+		return (offset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+	}
+
+	static uint64_t dataOffset_(const uint32_t mipLevels)
+	{
+		return align_(sizeof(Header) + mipLevels * sizeof(Level));
+	}
+
+	static void writePadding_(std::ofstream& file, const uint64_t offset)
+	{
+		while (static_cast<uint64_t>(file.tellp()) < offset)
+		{
+			file.put(0);
+		}
+	}
+
+	void readData_(void* destination) const
+	{
+		std::ifstream file(filename_, std::ios::binary);
+		file.seekg(static_cast<std::streamoff>(dataOffset_(header_.MipLevels)));
+		if (!file.read(static_cast<char*>(destination), static_cast<std::streamsize>(header_.DataSize)))
+		{
+			throw std::runtime_error("Could not read texture container data from [" + filename_ + "].");
+		}
+	}
+};
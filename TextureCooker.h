@@ -0,0 +1,81 @@
+#pragma once
+
+#include "stdafx.h"
+#include "BlockCompression.h"
+#include "JobSystem.h"
+#include "MipGenerator.h"
+#include "Texture.h"
+#include "TextureContainer.h"
+
+#include <vector>
+
+// Offline half of TextureContainer: decodes a source image once, builds its mip chain on the CPU (see MipGenerator), and
+// writes every level to a container the runtime uploads as-is, optionally block-compressed (see BlockCompression). Run
+// through the executable, see main.cpp.
+class TextureCooker
+{
+public:
+	static void Cook(const std::string& sourceFilename, const std::string& containerFilename,
+	                 const bool generateMipmaps, const vk::Format format = vk::Format::eR8G8B8A8Unorm,
+	                 const MipGenerator::Filter mipFilter = MipGenerator::Filter::Kaiser)
+	{
+		DebugMessage("TextureCooker::Cook(" + sourceFilename + ", " + containerFilename + ")");
+		const auto pixels = Texture::Decode(sourceFilename);
+
+		JobSystem jobSystem;
+		const auto mipLevels = generateMipmaps ? Texture::GetMipLevels(pixels.Width, pixels.Height) : 1;
+		const auto mipChain = MipGenerator::Generate(pixels.Data.get(), pixels.Width, pixels.Height, mipLevels,
+		                                             mipFilter, true, &jobSystem);
+
+		std::vector<std::vector<unsigned char>> levels;
+		std::vector<vk::Extent2D> extents;
+		for (const auto& level : mipChain)
+		{
+			levels.emplace_back(format == vk::Format::eR8G8B8A8Unorm
+				                    ? level.Pixels
+				                    : BlockCompression::Compress(format, level.Pixels.data(),
+				                                                 {level.Width, level.Height}, jobSystem));
+			extents.emplace_back(level.Width, level.Height);
+		}
+
+		TextureContainer::Write(containerFilename, format, levels, extents);
+	}
+
+	// Maps the names accepted on the command line (rgba8, bc1, bc3, bc7) to formats.
+	static vk::Format ParseFormat(const std::string& name)
+	{
+		if (name == "rgba8")
+		{
+			return vk::Format::eR8G8B8A8Unorm;
+		}
+		if (name == "bc1")
+		{
+			return vk::Format::eBc1RgbaUnormBlock;
+		}
+		if (name == "bc3")
+		{
+			return vk::Format::eBc3UnormBlock;
+		}
+		if (name == "bc7")
+		{
+			return vk::Format::eBc7UnormBlock;
+		}
+
+		throw std::runtime_error("Could not cook texture, unknown format [" + name + "].");
+	}
+
+	// Maps the names accepted on the command line (box, kaiser) to filters.
+	static MipGenerator::Filter ParseMipFilter(const std::string& name)
+	{
+		if (name == "box")
+		{
+			return MipGenerator::Filter::Box;
+		}
+		if (name == "kaiser")
+		{
+			return MipGenerator::Filter::Kaiser;
+		}
+
+		throw std::runtime_error("Could not cook texture, unknown mip filter [" + name + "].");
+	}
+};
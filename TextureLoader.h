@@ -0,0 +1,180 @@
+#pragma once
+
+#include "stdafx.h"
+#include "JobSystem.h"
+#include "Texture.h"
+#include "VulkanDeviceContext.h"
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Loads textures in the background: files are read and decoded (cooked TextureContainer files are only read) on the
+// loader's own JobSystem, and the results are handed to the upload path (see Texture) on the render thread, by Update().
+// Until then, callers draw with a 1x1 placeholder, which is also what they keep drawing if the texture fails to load.
+//
+// Decoding is kept off the shared per-frame JobSystem, whose workers steal from the render thread's queue, and which the
+// render thread helps drain while it waits on frame jobs: a frame would otherwise stall behind a whole stbi_load. The
+// shared JobSystem is only used for mipmap generation, which Update() runs on the render thread anyway.
+//
+// Creating the Texture is left to the render thread because StagingRing::Overflow::Wait may flush the TransferManager,
+// which only the thread that submits frames may do.
+class TextureLoader
+{
+public:
+	using Callback = std::function<void(const std::shared_ptr<Texture>&)>;
+	// Called instead of Callback with the exception that kept the texture from loading.
+	using ErrorCallback = std::function<void(const std::string& filename, std::exception_ptr error)>;
+
+	// Decoding is bound by disk I/O and stbi_load, the default of a quarter of the hardware threads keeps it from
+	// competing with the frame's workers.
+	TextureLoader(const VulkanDeviceContext& deviceContext, vk::UniqueCommandPool& commandPool,
+	              const std::shared_ptr<JobSystem>& jobSystem,
+	              const uint32_t numDecodeWorkers = defaultNumDecodeWorkers_()) :
+		deviceContext_(deviceContext), commandPool_(commandPool), jobSystem_(jobSystem),
+		decodeJobs_(std::max(numDecodeWorkers, 1u))
+	{
+		DebugMessage("TextureLoader::TextureLoader(numDecodeWorkers=" + std::to_string(numDecodeWorkers) + ")");
+		const std::shared_ptr<const unsigned char> white(new unsigned char[4]{255, 255, 255, 255},
+		                                                 std::default_delete<unsigned char[]>());
+		placeholder_ = std::make_shared<Texture>(Texture::Pixels{white, 1, 1}, deviceContext_, commandPool_, false);
+	}
+
+	~TextureLoader()
+	{
+		DebugMessage("TextureLoader::~TextureLoader()");
+		decodeJobs_.Wait(counter_);
+	}
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// Queues filename for decoding, and returns immediately. onLoaded is called from Update() with the uploaded
+	// texture, or onError if it could not be read, decoded or uploaded. Without an onError, the error is written to
+	// std::cerr.
+	void Load(const std::string& filename, const bool generateMipmaps, Callback onLoaded,
+	          ErrorCallback onError = nullptr)
+	{
+		DebugMessage("TextureLoader::Load(" + filename + ")");
+		decodeJobs_.Submit([this, filename, generateMipmaps, onLoaded = std::move(onLoaded),
+			                   onError = std::move(onError)]
+		{
+			Decoded decoded{filename, {}, nullptr, generateMipmaps, onLoaded, onError, nullptr};
+			try
+			{
+				if (TextureContainer::IsContainer(filename))
+				{
+					decoded.Container = std::make_shared<TextureContainer>(filename);
+					decoded.Container->Load();
+				}
+				else
+				{
+					decoded.Pixels = Texture::Decode(filename);
+				}
+			}
+			catch (...)
+			{
+				decoded.Error = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			decoded_.emplace_back(std::move(decoded));
+		}, counter_);
+	}
+
+	// Uploads every texture that has finished decoding, and calls its callback. A texture that fails to decode or
+	// upload is reported to its error callback instead, and doesn't keep the others from loading. Call once per frame
+	// from the render thread.
+	void Update()
+	{
+		std::vector<Decoded> decoded;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			decoded.swap(decoded_);
+		}
+
+		for (auto& texture : decoded)
+		{
+			if (texture.Error)
+			{
+				reportError_(texture);
+				continue;
+			}
+
+			std::shared_ptr<Texture> uploaded;
+			try
+			{
+				uploaded = texture.Container != nullptr
+					           ? std::make_shared<Texture>(*texture.Container, deviceContext_, commandPool_)
+					           : std::make_shared<Texture>(texture.Pixels, deviceContext_, commandPool_,
+					                                       texture.GenerateMipmaps, jobSystem_.get());
+			}
+			catch (...)
+			{
+				texture.Error = std::current_exception();
+				reportError_(texture);
+				continue;
+			}
+			texture.OnLoaded(uploaded);
+		}
+	}
+
+	[[nodiscard]] const std::shared_ptr<Texture>& GetPlaceholder() const
+	{
+		return placeholder_;
+	}
+
+private:
+	struct Decoded
+	{
+		std::string Filename;
+		Texture::Pixels Pixels;
+		// Set instead of Pixels for cooked textures, with its texel data already read into memory.
+		std::shared_ptr<TextureContainer> Container;
+		bool GenerateMipmaps;
+		Callback OnLoaded;
+		ErrorCallback OnError;
+		std::exception_ptr Error;
+	};
+
+	const VulkanDeviceContext deviceContext_;
+	vk::UniqueCommandPool& commandPool_;
+	std::shared_ptr<JobSystem> jobSystem_;
+	std::shared_ptr<Texture> placeholder_;
+	JobSystem::Counter counter_;
+	std::mutex mutex_;
+	std::vector<Decoded> decoded_;
+	// Declared last, so its workers are joined before the state their jobs use is destroyed.
+	JobSystem decodeJobs_;
+
+	static uint32_t defaultNumDecodeWorkers_()
+	{
+		return std::max(std::thread::hardware_concurrency() / 4, 1u);
+	}
+
+	static void reportError_(const Decoded& texture)
+	{
+		if (texture.OnError)
+		{
+			texture.OnError(texture.Filename, texture.Error);
+			return;
+		}
+
+		try
+		{
+			std::rethrow_exception(texture.Error);
+		}
+		catch (const std::exception& exception)
+		{
+			std::cerr << "Could not load texture [" << texture.Filename << "]: " << exception.what() << std::endl;
+		}
+		catch (...)
+		{
+			std::cerr << "Could not load texture [" << texture.Filename << "]." << std::endl;
+		}
+	}
+};
@@ -0,0 +1,389 @@
+#pragma once
+
+#include "stdafx.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Batches uploads (buffer copies, image layout transitions, mip generation) into command buffers that are submitted to
+// the queue without blocking. Every submitted batch signals its own vk::Fence, and is identified by a Handle callers can
+// poll or wait on. Resources a batch reads from, like staging buffers, are kept alive until its fence is signaled.
+//
+// When the device has a dedicated transfer queue family, copies run on it, concurrently with rendering. Each batch then
+// also gets a command buffer on the graphics queue, which waits on the transfer submission with a semaphore, and holds
+// the queue family ownership acquires plus anything the transfer queue can't do (blits, transitions to shader stages).
+// Batches that rewrite buffers the graphics queue family already owns also get a command buffer that releases them back
+// to the transfer family, submitted to the graphics queue ahead of the transfer submission, which waits on it.
+// Otherwise both kinds of commands share one command buffer on the graphics queue.
+//
+// Each batch ends with a global memory barrier on the graphics queue, so any work submitted to it afterwards (i.e. the
+// frame that first draws the uploaded resources) sees the results without having to wait on the CPU.
+//
+// Batches are reusable one-time-submit contexts: each owns a transient command pool per queue family, which is reset
+// wholesale when the batch is recycled, so recording an upload never allocates or resets individual command buffers.
+class TransferManager
+{
+public:
+	using Handle = uint64_t;
+
+	enum class Queue
+	{
+		Transfer,
+		Graphics
+	};
+
+	TransferManager(const std::shared_ptr<vk::Device>& logicalDevice, const std::shared_ptr<vk::Queue>& transferQueue,
+	                const uint32_t transferQueueFamilyIndex, const std::shared_ptr<vk::Queue>& graphicsQueue,
+	                const uint32_t graphicsQueueFamilyIndex) : logicalDevice_(logicalDevice),
+	                                                           transferQueue_(transferQueue),
+	                                                           graphicsQueue_(graphicsQueue),
+	                                                           transferQueueFamilyIndex_(transferQueueFamilyIndex),
+	                                                           graphicsQueueFamilyIndex_(graphicsQueueFamilyIndex)
+	{
+		DebugMessage("TransferManager::TransferManager(transferFamily=" + std::to_string(transferQueueFamilyIndex_) +
+			", graphicsFamily=" + std::to_string(graphicsQueueFamilyIndex_) + ")");
+	}
+
+	~TransferManager()
+	{
+		DebugMessage("TransferManager::~TransferManager()");
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto& batch : submittedBatches_)
+		{
+			waitForFence_(batch);
+		}
+	}
+
+	TransferManager(const TransferManager&) = delete;
+	TransferManager& operator=(const TransferManager&) = delete;
+
+	// Records into the currently open batch, beginning a new one if needed. The returned Handle identifies the batch the
+	// commands end up in. Commands recorded by the same thread before the next Flush() execute in order, and a batch's
+	// Graphics commands always execute after all of its Transfer commands.
+	template <typename RecordFunction>
+	Handle Record(RecordFunction&& record, const Queue queue = Queue::Transfer)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& batch = beginBatch_();
+		record(queue == Queue::Graphics && HasDedicatedQueue()
+			       ? batch.GraphicsCommandBuffer.get()
+			       : batch.CommandBuffer.get());
+		return batch.Id;
+	}
+
+	// Hands a range of a buffer written by Transfer commands over to the graphics queue family. A no-op without a
+	// dedicated transfer queue. Call after the last Transfer command that writes it.
+	void TransferOwnership(const vk::Buffer buffer, const vk::DeviceSize offset, const vk::DeviceSize size)
+	{
+		if (!HasDedicatedQueue())
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& batch = beginBatch_();
+		batch.CommandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+		                                     vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr,
+		                                     vk::BufferMemoryBarrier(vk::AccessFlagBits::eTransferWrite, {},
+		                                                             transferQueueFamilyIndex_,
+		                                                             graphicsQueueFamilyIndex_, buffer, offset, size),
+		                                     nullptr);
+		batch.GraphicsCommandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+		                                             vk::PipelineStageFlagBits::eAllCommands, {}, nullptr,
+		                                             vk::BufferMemoryBarrier({}, vk::AccessFlagBits::eMemoryRead |
+		                                                                     vk::AccessFlagBits::eMemoryWrite,
+		                                                                     transferQueueFamilyIndex_,
+		                                                                     graphicsQueueFamilyIndex_, buffer, offset,
+		                                                                     size), nullptr);
+	}
+
+	// Hands a range of a buffer the graphics queue family owns back to the transfer family, so Transfer commands may
+	// write it again. The release runs on the graphics queue after everything submitted to it before this batch, so it
+	// waits for the frames that still read the range. A no-op without a dedicated transfer queue. Call before the first
+	// Transfer command that writes it, and hand it back with TransferOwnership() after the last.
+	void ReclaimOwnership(const vk::Buffer buffer, const vk::DeviceSize offset, const vk::DeviceSize size)
+	{
+		if (!HasDedicatedQueue())
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& batch = beginBatch_();
+		if (!batch.HasReleases)
+		{
+			if (!batch.ReleaseCommandBuffer)
+			{
+				batch.ReleaseCommandBuffer = std::move(logicalDevice_->allocateCommandBuffersUnique({
+					batch.GraphicsCommandPool.get(), vk::CommandBufferLevel::ePrimary, 1
+				})[0]);
+				batch.ReleaseSemaphore = logicalDevice_->createSemaphoreUnique({});
+			}
+			batch.ReleaseCommandBuffer->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+			batch.HasReleases = true;
+		}
+
+		batch.ReleaseCommandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
+		                                            vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr,
+		                                            vk::BufferMemoryBarrier(vk::AccessFlagBits::eMemoryWrite, {},
+		                                                                    graphicsQueueFamilyIndex_,
+		                                                                    transferQueueFamilyIndex_, buffer, offset,
+		                                                                    size), nullptr);
+		batch.CommandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+		                                     vk::PipelineStageFlagBits::eTransfer, {}, nullptr,
+		                                     vk::BufferMemoryBarrier({}, vk::AccessFlagBits::eTransferWrite,
+		                                                             graphicsQueueFamilyIndex_,
+		                                                             transferQueueFamilyIndex_, buffer, offset, size),
+		                                     nullptr);
+	}
+
+	// The image keeps its layout across the transfer.
+	void TransferOwnership(const vk::Image image, const vk::ImageSubresourceRange& subresourceRange,
+	                       const vk::ImageLayout layout)
+	{
+		if (!HasDedicatedQueue())
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& batch = beginBatch_();
+		batch.CommandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+		                                     vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr,
+		                                     vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite, {}, layout,
+		                                                            layout, transferQueueFamilyIndex_,
+		                                                            graphicsQueueFamilyIndex_, image,
+		                                                            subresourceRange));
+		batch.GraphicsCommandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+		                                             vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr,
+		                                             vk::ImageMemoryBarrier({}, vk::AccessFlagBits::eMemoryRead |
+		                                                                    vk::AccessFlagBits::eMemoryWrite, layout,
+		                                                                    layout, transferQueueFamilyIndex_,
+		                                                                    graphicsQueueFamilyIndex_, image,
+		                                                                    subresourceRange));
+	}
+
+	[[nodiscard]] bool HasDedicatedQueue() const
+	{
+		return transferQueueFamilyIndex_ != graphicsQueueFamilyIndex_;
+	}
+
+	// Keeps resource alive until the currently open batch has finished executing on the GPU.
+	void KeepAlive(std::shared_ptr<const void> resource)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		beginBatch_().Resources.emplace_back(std::move(resource));
+	}
+
+	// Submits the open batch, if there is one. Never blocks. vk::Queue access must be externally synchronized, so only
+	// call this from the thread that submits frames.
+	void Flush()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		flush_();
+	}
+
+	[[nodiscard]] bool IsComplete(const Handle handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (handle >= nextId_ || (openBatch_ != nullptr && handle == openBatch_->Id))
+		{
+			return false;
+		}
+
+		for (auto& batch : submittedBatches_)
+		{
+			if (batch.Id == handle)
+			{
+				return logicalDevice_->getFenceStatus(batch.Fence.get()) == vk::Result::eSuccess;
+			}
+		}
+
+		return true;
+	}
+
+	// Blocks until the batch identified by handle has finished executing, submitting it first if it is still open (see
+	// Flush() for which thread may do that).
+	void Wait(const Handle handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (openBatch_ != nullptr && handle == openBatch_->Id)
+		{
+			flush_();
+		}
+
+		for (auto& batch : submittedBatches_)
+		{
+			if (batch.Id == handle)
+			{
+				waitForFence_(batch);
+			}
+		}
+	}
+
+	// Releases the resources of every batch that has finished executing, and recycles its command pools and fence.
+	void Collect()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto batch = submittedBatches_.begin(); batch != submittedBatches_.end();)
+		{
+			if (logicalDevice_->getFenceStatus(batch->Fence.get()) != vk::Result::eSuccess)
+			{
+				++batch;
+				continue;
+			}
+
+			batch->Resources.clear();
+			freeBatches_.emplace_back(std::move(*batch));
+			batch = submittedBatches_.erase(batch);
+		}
+	}
+
+private:
+	struct Batch
+	{
+		Handle Id = 0;
+		// Declared before the command buffers allocated from them, so they are destroyed after them.
+		vk::UniqueCommandPool CommandPool;
+		vk::UniqueCommandPool GraphicsCommandPool;
+		vk::UniqueCommandBuffer CommandBuffer;
+		// Only used with a dedicated transfer queue, like GraphicsCommandPool.
+		vk::UniqueCommandBuffer GraphicsCommandBuffer;
+		vk::UniqueSemaphore Semaphore;
+		// Ownership releases from the graphics queue family, see ReclaimOwnership(). Created the first time a batch needs
+		// them, and only submitted when HasReleases.
+		vk::UniqueCommandBuffer ReleaseCommandBuffer;
+		vk::UniqueSemaphore ReleaseSemaphore;
+		bool HasReleases = false;
+		vk::UniqueFence Fence;
+		std::vector<std::shared_ptr<const void>> Resources;
+	};
+
+	std::shared_ptr<vk::Device> logicalDevice_;
+	std::shared_ptr<vk::Queue> transferQueue_;
+	std::shared_ptr<vk::Queue> graphicsQueue_;
+	uint32_t transferQueueFamilyIndex_;
+	uint32_t graphicsQueueFamilyIndex_;
+	std::mutex mutex_;
+	std::unique_ptr<Batch> openBatch_;
+	std::vector<Batch> submittedBatches_;
+	std::vector<Batch> freeBatches_;
+	Handle nextId_ = 1;
+
+	Batch& beginBatch_()
+	{
+		if (openBatch_ != nullptr)
+		{
+			return *openBatch_;
+		}
+
+		openBatch_ = std::make_unique<Batch>();
+		if (!freeBatches_.empty())
+		{
+			*openBatch_ = std::move(freeBatches_.back());
+			freeBatches_.pop_back();
+			logicalDevice_->resetCommandPool(openBatch_->CommandPool.get(), {});
+			if (HasDedicatedQueue())
+			{
+				logicalDevice_->resetCommandPool(openBatch_->GraphicsCommandPool.get(), {});
+			}
+			logicalDevice_->resetFences(openBatch_->Fence.get());
+		}
+		else
+		{
+			openBatch_->CommandPool = createCommandPool_(transferQueueFamilyIndex_);
+			openBatch_->CommandBuffer = std::move(logicalDevice_->allocateCommandBuffersUnique({
+				openBatch_->CommandPool.get(), vk::CommandBufferLevel::ePrimary, 1
+			})[0]);
+			if (HasDedicatedQueue())
+			{
+				openBatch_->GraphicsCommandPool = createCommandPool_(graphicsQueueFamilyIndex_);
+				openBatch_->GraphicsCommandBuffer = std::move(logicalDevice_->allocateCommandBuffersUnique({
+					openBatch_->GraphicsCommandPool.get(), vk::CommandBufferLevel::ePrimary, 1
+				})[0]);
+				openBatch_->Semaphore = logicalDevice_->createSemaphoreUnique({});
+			}
+			openBatch_->Fence = logicalDevice_->createFenceUnique({});
+		}
+
+		openBatch_->Id = nextId_++;
+		openBatch_->HasReleases = false;
+		openBatch_->CommandBuffer->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+		if (HasDedicatedQueue())
+		{
+			openBatch_->GraphicsCommandBuffer->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+		}
+		return *openBatch_;
+	}
+
+	void flush_()
+	{
+		if (openBatch_ == nullptr)
+		{
+			return;
+		}
+
+		auto& commandBuffer = HasDedicatedQueue() ? openBatch_->GraphicsCommandBuffer : openBatch_->CommandBuffer;
+		const vk::MemoryBarrier memoryBarrier(vk::AccessFlagBits::eTransferWrite,
+		                                      vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite);
+		commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+		                               {}, memoryBarrier, nullptr, nullptr);
+
+		if (HasDedicatedQueue())
+		{
+			openBatch_->CommandBuffer->end();
+			commandBuffer->end();
+
+			const vk::PipelineStageFlags releaseWaitStage = vk::PipelineStageFlagBits::eTransfer;
+			if (openBatch_->HasReleases)
+			{
+				openBatch_->ReleaseCommandBuffer->end();
+				const vk::SubmitInfo releaseSubmitInfo({}, {}, {}, 1, &openBatch_->ReleaseCommandBuffer.get(), 1,
+				                                       &openBatch_->ReleaseSemaphore.get());
+				graphicsQueue_->submit(releaseSubmitInfo, nullptr);
+			}
+
+			const vk::SubmitInfo transferSubmitInfo(openBatch_->HasReleases ? 1 : 0, &openBatch_->ReleaseSemaphore.get(),
+			                                        &releaseWaitStage, 1, &openBatch_->CommandBuffer.get(), 1,
+			                                        &openBatch_->Semaphore.get());
+			transferQueue_->submit(transferSubmitInfo, nullptr);
+
+			const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+			const vk::SubmitInfo graphicsSubmitInfo(1, &openBatch_->Semaphore.get(), &waitStage, 1,
+			                                        &commandBuffer.get());
+			graphicsQueue_->submit(graphicsSubmitInfo, openBatch_->Fence.get());
+		}
+		else
+		{
+			commandBuffer->end();
+
+			const vk::SubmitInfo submitInfo({}, {}, {}, 1, &commandBuffer.get());
+			graphicsQueue_->submit(submitInfo, openBatch_->Fence.get());
+		}
+		submittedBatches_.emplace_back(std::move(*openBatch_));
+		openBatch_.reset();
+	}
+
+	vk::UniqueCommandPool createCommandPool_(const uint32_t queueFamilyIndex) const
+	{
+		auto commandPool = logicalDevice_->createCommandPoolUnique({
+			vk::CommandPoolCreateFlagBits::eTransient, queueFamilyIndex
+		});
+		if (!commandPool)
+		{
+			throw std::runtime_error(
+				"Could not create vk::CommandPool for TransferManager. Verify your hardware is supported, and your drivers are up-to-date.");
+		}
+		return commandPool;
+	}
+
+	void waitForFence_(const Batch& batch) const
+	{
+		const auto result = logicalDevice_->waitForFences(batch.Fence.get(), VK_TRUE, UINT64_MAX);
+		if (result != vk::Result::eSuccess)
+		{
+			throw std::runtime_error("Could not wait for TransferManager batch [" + std::to_string(batch.Id) + "].");
+		}
+	}
+};
@@ -39,15 +39,23 @@ namespace Util
 			", properties=" + std::to_string(static_cast<uint32_t>(properties)) + ".");
 	}
 
+	// Returns the first candidate that supports formatFeatureFlags with the given tiling, throws if none does.
 	static vk::Format FindSupportedFormat(const VulkanDeviceContext& deviceContext, const std::vector<vk::Format>& candidates, vk::ImageTiling imageTiling, vk::FormatFeatureFlags formatFeatureFlags)
 	{
 		const auto physicalDevice = *deviceContext.PhysicalDevice;
-		return *std::find_if(candidates.begin(), candidates.end(), [physicalDevice, imageTiling, formatFeatureFlags](auto candidate)
+		const auto format = std::find_if(candidates.begin(), candidates.end(), [physicalDevice, imageTiling, formatFeatureFlags](auto candidate)
 			{
 				auto physicalDeviceProperties = physicalDevice.getFormatProperties(candidate);
 				return (imageTiling == vk::ImageTiling::eLinear && (physicalDeviceProperties.linearTilingFeatures & formatFeatureFlags) == formatFeatureFlags) ||
 					(imageTiling == vk::ImageTiling::eOptimal && (physicalDeviceProperties.optimalTilingFeatures & formatFeatureFlags) == formatFeatureFlags);
 			});
+		if (format == candidates.end())
+		{
+			throw std::runtime_error(
+				"Could not find supported vk::Format among [" + std::to_string(candidates.size()) + "] candidates, tiling=" +
+				vk::to_string(imageTiling) + ", features=" + vk::to_string(formatFeatureFlags) + ".");
+		}
+		return *format;
 	}
 
 	// static vk::UniqueCommandBuffer& BeginOneTimeSubmitCommand(const VulkanDeviceContext& deviceContext, vk::UniqueCommandPool& commandPool)
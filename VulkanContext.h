@@ -9,6 +9,10 @@
 #include "Image.h"
 #include "VulkanDeviceContext.h"
 #include "Mesh.h"
+#include "ParticleEffect.h"
+#include "ParticleInstance.h"
+#include "SamplerCache.h"
+#include "StagingRing.h"
 #include "VulkanParticlesException.h"
 
 class VulkanContext
@@ -80,7 +84,7 @@ public:
 	};
 
 	// might want to hard-code descriptorsetlayouts in here for now, to enforce separation of concerns.
-	void Initialize(GLFWwindow* appWindow, const vk::Extent2D swapchainExtent, const vk::Format imageFormat, const std::stringstream& vertexShaderSource, const std::stringstream& fragmentShaderSource, const float minDepth, const float maxDepth, const int maxFramesInFlight)
+	void Initialize(GLFWwindow* appWindow, const vk::Extent2D swapchainExtent, const vk::Format imageFormat, const std::stringstream& vertexShaderSource, const std::stringstream& fragmentShaderSource, const std::stringstream& particleVertexShaderSource, const std::stringstream& particleComputeShaderSource, const float minDepth, const float maxDepth, const int maxFramesInFlight, const vk::DeviceSize stagingBufferSize = StagingRing::DEFAULT_SIZE, const StagingRing::Overflow stagingOverflow = StagingRing::Overflow::Allocate)
 	{
 		CreateSurface(appWindow);
 		SelectPhysicalDevice();
@@ -90,19 +94,23 @@ public:
 		CreateRenderPass(imageFormat);
 		CreateDescriptorPool();
 		CreateCommandPool();
+		CreateStagingRing(stagingBufferSize, stagingOverflow);
+		CreateUniformBuffer(maxFramesInFlight);
 
 		// TODO: [zpuls 2020-08-08T15:55] Figure out wtf to do about dynamic descriptorset/layout binding....NVIDIA only supports 8 bound at a time? Not sure I understand the concept fully.
-		vk::DescriptorSetLayoutBinding uboLayoutBinding = { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex };
+		vk::DescriptorSetLayoutBinding uboLayoutBinding = { 0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex };
 		vk::DescriptorSetLayoutBinding samplerLayoutBinding = { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment };
 		
 		const auto descriptorSetLayoutIndex = AddDescriptorSetLayout({ uboLayoutBinding, samplerLayoutBinding });
 		
 		CreateGraphicsPipeline(vertexShaderSource, fragmentShaderSource, Vertex::GetVertexInputBindingDescription(), Vertex::GetVertexInputAttributeDescriptions(), minDepth, maxDepth);
+		CreateParticlePipeline(particleVertexShaderSource, fragmentShaderSource, minDepth, maxDepth);
+		CreateComputePipeline(particleComputeShaderSource);
 		CreateDepthBuffer();
 		CreateFramebuffers();
 		// create descriptor sets here?
-		CreateCommandBuffers();
 		CreateSyncObjects(maxFramesInFlight);
+		CreateCommandBuffers();
 	}
 	
 	void CreateSurface(GLFWwindow* appWindow)
@@ -148,6 +156,10 @@ public:
 
 		std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
 		std::set<uint32_t> uniqueQueueFamilies = { indices.GraphicsFamily.value(), indices.PresentFamily.value() };
+		if (indices.TransferFamily.has_value())
+		{
+			uniqueQueueFamilies.insert(indices.TransferFamily.value());
+		}
 
 		auto queuePriority = 1.0f;
 		for (auto queueFamily : uniqueQueueFamilies)
@@ -160,6 +172,8 @@ public:
 
 		vk::PhysicalDeviceFeatures physicalDeviceFeatures;
 		physicalDeviceFeatures.samplerAnisotropy = VK_TRUE;
+		// Optional, cooked BC textures check their format's support before they are created, see Texture.
+		physicalDeviceFeatures.textureCompressionBC = deviceContext_.PhysicalDevice->getFeatures().textureCompressionBC;
 		deviceContext_.LogicalDevice = std::make_shared<vk::Device>(deviceContext_.PhysicalDevice->createDevice(vk::DeviceCreateInfo({},
 			static_cast<
 			uint32_t>(
@@ -186,6 +200,19 @@ public:
 
 		deviceContext_.GraphicsQueue = std::make_shared<vk::Queue>(deviceContext_.LogicalDevice->getQueue(indices.GraphicsFamily.value(), 0));
 		deviceContext_.PresentQueue = std::make_shared<vk::Queue>(deviceContext_.LogicalDevice->getQueue(indices.PresentFamily.value(), 0));
+		deviceContext_.GraphicsQueueFamily = indices.GraphicsFamily.value();
+		deviceContext_.TransferQueueFamily = indices.TransferFamily.value_or(deviceContext_.GraphicsQueueFamily);
+		deviceContext_.TransferQueue = indices.TransferFamily.has_value()
+			                               ? std::make_shared<vk::Queue>(deviceContext_.LogicalDevice->getQueue(indices.TransferFamily.value(), 0))
+			                               : deviceContext_.GraphicsQueue;
+		deviceContext_.Allocator = std::make_shared<MemoryAllocator>(deviceContext_.PhysicalDevice,
+		                                                             deviceContext_.LogicalDevice);
+		deviceContext_.Transfers = std::make_shared<TransferManager>(deviceContext_.LogicalDevice, deviceContext_.TransferQueue,
+		                                                             deviceContext_.TransferQueueFamily, deviceContext_.GraphicsQueue,
+		                                                             deviceContext_.GraphicsQueueFamily);
+		deviceContext_.Samplers = std::make_shared<SamplerCache>(deviceContext_.LogicalDevice,
+		                                                         deviceContext_.PhysicalDevice->getProperties().limits.
+		                                                         maxSamplerAnisotropy);
 	}
 
 	void CreateSwapchain(const vk::Extent2D& requestedSwapchainExtent)
@@ -304,43 +331,10 @@ public:
 	                                  const std::array<vk::VertexInputAttributeDescription, 3>&
 	                                  vertexInputAttributeDescriptions, const float minDepth, const float maxDepth)
 	{
-		auto vertexShaderModule = createShaderModule_(vertexShaderSource);
-		auto fragmentShaderModule = createShaderModule_(fragmentShaderSource);
-
-		vk::PipelineShaderStageCreateInfo vertexShaderPipelineShaderStageCreateInfo(
-			{}, vk::ShaderStageFlagBits::eVertex, vertexShaderModule.get(), "main");
-
-		vk::PipelineShaderStageCreateInfo fragmentShaderPipelineShaderStageCreateInfo(
-			{}, vk::ShaderStageFlagBits::eFragment, fragmentShaderModule.get(), "main");
-
-		vk::PipelineShaderStageCreateInfo pipelineShaderStageCreateInfos[] = {
-			vertexShaderPipelineShaderStageCreateInfo, fragmentShaderPipelineShaderStageCreateInfo
-		};
-		vk::PipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo(
-			{}, 1, &vertexInputBindingDescription, static_cast<uint32_t>(vertexInputAttributeDescriptions.size()), &vertexInputAttributeDescriptions[0]);
-		vk::PipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo(
-			{}, vk::PrimitiveTopology::eTriangleList);
-		vk::Viewport viewport(0.0f, 0.0f, static_cast<float>(swapchainExtent_.width),
-			static_cast<float>(swapchainExtent_.height), minDepth, maxDepth);
-		vk::Rect2D scissor({ 0, 0 }, swapchainExtent_);
-		vk::PipelineViewportStateCreateInfo pipelineViewportStateCreateInfo({}, 1, &viewport, 1, &scissor);
-		vk::PipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo(
-			{}, VK_FALSE, VK_FALSE, vk::PolygonMode::eFill, vk::CullModeFlagBits::eBack,
-			vk::FrontFace::eCounterClockwise,
-			VK_FALSE, 0.0f, 0.0f, 0.0f, 1.0f);
-		vk::PipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo(
-			{}, vk::SampleCountFlagBits::e1, VK_FALSE);
-		vk::PipelineDepthStencilStateCreateInfo pipelineDepthStencilStateCreateInfo({}, VK_TRUE, VK_TRUE, vk::CompareOp::eLess, VK_FALSE, VK_FALSE, {}, {}, 0.0f, 1.0f);
-		vk::PipelineColorBlendAttachmentState pipelineColorBlendAttachmentState(VK_FALSE, {}, {}, {}, {}, {}, {},
-			vk::ColorComponentFlagBits::eR | vk::
-			ColorComponentFlagBits::eG | vk::
-			ColorComponentFlagBits::eB | vk::
-			ColorComponentFlagBits::eA);
-		vk::PipelineColorBlendStateCreateInfo pipelineColorBlendStateCreateInfo(
-			{}, VK_FALSE, vk::LogicOp::eCopy, 1, &pipelineColorBlendAttachmentState);
-
 		const auto rawDescriptorSetLayouts = vk::uniqueToRaw(descriptorSetLayouts_);
-		vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo({}, rawDescriptorSetLayouts.size(), &rawDescriptorSetLayouts[0]);
+		// Per-draw model matrices are pushed as constants, view and projection come from the per-frame uniform data.
+		const vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4));
+		vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo({}, rawDescriptorSetLayouts.size(), &rawDescriptorSetLayouts[0], 1, &pushConstantRange);
 		graphicsPipelineLayout_ = deviceContext_.LogicalDevice->createPipelineLayoutUnique(pipelineLayoutCreateInfo);
 		if (!graphicsPipelineLayout_)
 		{
@@ -348,25 +342,61 @@ public:
 				"Could not create vk::PipelineLayout for the Vulkan graphics pipeline. Verify your hardware is supported, and your drivers are up-to-date.");
 		}
 
-		graphicsPipeline_ = deviceContext_.LogicalDevice->createGraphicsPipelineUnique(nullptr, {
-			                                                                               {}, 2,
-			                                                                               pipelineShaderStageCreateInfos,
-			                                                                               &pipelineVertexInputStateCreateInfo,
-			                                                                               &pipelineInputAssemblyStateCreateInfo,
-			                                                                               nullptr,
-			                                                                               &pipelineViewportStateCreateInfo,
-			                                                                               &pipelineRasterizationStateCreateInfo,
-			                                                                               &pipelineMultisampleStateCreateInfo,
-			                                                                               &pipelineDepthStencilStateCreateInfo,
-			                                                                               &pipelineColorBlendStateCreateInfo,
-			                                                                               nullptr,
-			                                                                               *graphicsPipelineLayout_,
-			                                                                               *renderPass_
-		                                                                               });
-		if (!graphicsPipeline_)
+		graphicsPipeline_ = createGraphicsPipeline_(vertexShaderSource, fragmentShaderSource,
+		                                            {vertexInputBindingDescription},
+		                                            {
+			                                            vertexInputAttributeDescriptions.begin(),
+			                                            vertexInputAttributeDescriptions.end()
+		                                            }, minDepth, maxDepth);
+	}
+
+	// The instanced particle pipeline reads the unit quad's ::Vertex stream at binding 0, and one ::ParticleInstance per
+	// particle at binding 1. It shares the graphics pipeline layout, so the same descriptor sets can be bound for both.
+	void CreateParticlePipeline(const std::stringstream& vertexShaderSource,
+	                            const std::stringstream& fragmentShaderSource, const float minDepth, const float maxDepth)
+	{
+		const auto vertexInputAttributeDescriptions = Vertex::GetVertexInputAttributeDescriptions();
+		const auto instanceInputAttributeDescriptions = ParticleInstance::GetVertexInputAttributeDescriptions();
+		std::vector<vk::VertexInputAttributeDescription> inputAttributeDescriptions(
+			vertexInputAttributeDescriptions.begin(), vertexInputAttributeDescriptions.end());
+		inputAttributeDescriptions.insert(inputAttributeDescriptions.end(), instanceInputAttributeDescriptions.begin(),
+		                                  instanceInputAttributeDescriptions.end());
+
+		particlePipeline_ = createGraphicsPipeline_(vertexShaderSource, fragmentShaderSource,
+		                                            {
+			                                            Vertex::GetVertexInputBindingDescription(),
+			                                            ParticleInstance::GetVertexInputBindingDescription()
+		                                            }, inputAttributeDescriptions, minDepth, maxDepth);
+	}
+
+	// The compute pipeline simulates ParticleEffect::RenderMode::Compute effects. Its descriptor set layout is kept apart
+	// from descriptorSetLayouts_, which all make up the graphics pipeline layout.
+	void CreateComputePipeline(const std::stringstream& computeShaderSource)
+	{
+		const auto computeLayoutBindings = ParticleEffect::GetComputeDescriptorSetLayoutBindings();
+		computeDescriptorSetLayout_ = deviceContext_.LogicalDevice->createDescriptorSetLayoutUnique({
+			{}, static_cast<uint32_t>(computeLayoutBindings.size()), &computeLayoutBindings[0]
+		});
+
+		const vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eCompute, 0,
+		                                              sizeof(ParticleEffect::ComputePushConstants));
+		computePipelineLayout_ = deviceContext_.LogicalDevice->createPipelineLayoutUnique({
+			{}, 1, &computeDescriptorSetLayout_.get(), 1, &pushConstantRange
+		});
+		if (!computePipelineLayout_)
 		{
 			throw std::runtime_error(
-				"Could not create vk::Pipeline for the Vulkan graphics pipeline. Verify your hardware is supported, and your drivers are up-to-date.");
+				"Could not create vk::PipelineLayout for the Vulkan compute pipeline. Verify your hardware is supported, and your drivers are up-to-date.");
+		}
+
+		auto computeShaderModule = createShaderModule_(computeShaderSource);
+		computePipeline_ = deviceContext_.LogicalDevice->createComputePipelineUnique(nullptr, {
+			{}, {{}, vk::ShaderStageFlagBits::eCompute, computeShaderModule.get(), "main"}, *computePipelineLayout_
+		});
+		if (!computePipeline_)
+		{
+			throw std::runtime_error(
+				"Could not create vk::Pipeline for the Vulkan compute pipeline. Verify your hardware is supported, and your drivers are up-to-date.");
 		}
 	}
 
@@ -391,8 +421,7 @@ public:
 	{
 		auto queueFamilyIndices = findQueueFamilies_(*deviceContext_.PhysicalDevice);
 		commandPool_ = deviceContext_.LogicalDevice->createCommandPoolUnique({
-			vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
-			queueFamilyIndices.GraphicsFamily.value()
+			vk::CommandPoolCreateFlagBits::eTransient, queueFamilyIndices.GraphicsFamily.value()
 		});
 		if (!commandPool_)
 		{
@@ -401,6 +430,12 @@ public:
 		}
 	}
 
+	// Every upload sub-allocates its staging memory from this ring, see StagingRing.
+	void CreateStagingRing(const vk::DeviceSize size, const StagingRing::Overflow overflow)
+	{
+		deviceContext_.Staging = std::make_shared<StagingRing>(deviceContext_, commandPool_, size, overflow);
+	}
+
 	void CreateDepthBuffer()
 	{
 		const auto imageFormat = Util::FindSupportedFormat(deviceContext_,
@@ -416,19 +451,10 @@ public:
 		depthImage_->CreateImageView(imageFormat, vk::ImageAspectFlagBits::eDepth);
 	}
 
-	void CreateUniformBuffers(const size_t bufferSize)
+	void CreateUniformBuffer(const uint32_t maxFramesInFlight)
 	{
-		uniformBuffers_.resize(swapchainImages_.size());
-
-		for (size_t i = 0; i < swapchainImages_.size(); ++i)
-		{
-			uniformBuffers_[i].reset(new GenericBuffer(deviceContext_, commandPool_, bufferSize,
-			                                           vk::BufferUsageFlagBits::eUniformBuffer,
-			                                           vk::SharingMode::eExclusive,
-			                                           vk::MemoryPropertyFlagBits::eHostVisible |
-			                                           vk::MemoryPropertyFlagBits::eHostCoherent,
-			                                           "VulkanContext::uniformBuffers_[" + std::to_string(i) + "]"));
-		}
+		uniformBuffer_ = std::make_shared<DynamicUniformBuffer>(deviceContext_, commandPool_, MAX_UNIFORM_DATA_PER_FRAME,
+		                                                        maxFramesInFlight, "VulkanContext::uniformBuffer_");
 	}
 
 	void CreateDescriptorPool()
@@ -436,16 +462,24 @@ public:
 		const std::vector<vk::DescriptorPoolSize> descriptorPoolSizes = {
 			{
 				vk::DescriptorType::eUniformBuffer,
-				static_cast<uint32_t>(swapchainImages_.size())
+				MAX_DESCRIPTOR_SETS
+			},
+			{
+				vk::DescriptorType::eUniformBufferDynamic,
+				MAX_DESCRIPTOR_SETS
 			},
 			{
 				vk::DescriptorType::eCombinedImageSampler,
-				static_cast<uint32_t>(swapchainImages_.size())
+				MAX_DESCRIPTOR_SETS
+			},
+			{
+				vk::DescriptorType::eStorageBuffer,
+				MAX_DESCRIPTOR_SETS * 3
 			}
 		};
 		descriptorPool_ = deviceContext_.LogicalDevice->createDescriptorPoolUnique({
 			{vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet},
-			static_cast<uint32_t>(swapchainImages_.size()),
+			MAX_DESCRIPTOR_SETS,
 			static_cast<uint32_t>(descriptorPoolSizes.size()), &descriptorPoolSizes[0]
 		});
 	}
@@ -454,34 +488,154 @@ public:
 	 * TODO: Break out CommandBuffer creation, allow mesh uploading from VulkanRenderingEngine, and instead of having the user pass in a single ::Mesh,
 	 * iterate through all of the active meshes, and render out each mesh for each vk::CommandBuffer's render pass.
 	 */
+	// One vk::CommandBuffer per frame in flight, not per swapchain image, each allocated from a transient pool of its own.
+	// A frame's pool is reset wholesale once that frame's fence has been waited on, see WaitForFences().
 	void CreateCommandBuffers()
 	{
-		const vk::CommandBufferAllocateInfo commandBufferAllocateInfo(*commandPool_, vk::CommandBufferLevel::ePrimary,
-		                                                              static_cast<uint32_t>(swapchainFramebuffers_.
-			                                                              size()));
-		commandBuffers_ = deviceContext_.LogicalDevice->allocateCommandBuffersUnique(commandBufferAllocateInfo);
-		if (commandBuffers_.empty())
+		commandBuffers_.clear();
+		frameCommandPools_.clear();
+		for (size_t i = 0; i < maxFramesInFlight_; ++i)
 		{
-			throw std::runtime_error(
-				"Could not allocate vk::CommandBuffer(s). Verify your hardware is supported, and your drivers are up-to-date.");
+			auto commandPool = deviceContext_.LogicalDevice->createCommandPoolUnique({
+				vk::CommandPoolCreateFlagBits::eTransient, deviceContext_.GraphicsQueueFamily
+			});
+			auto commandBuffers = deviceContext_.LogicalDevice->allocateCommandBuffersUnique({
+				commandPool.get(), vk::CommandBufferLevel::ePrimary, 1
+			});
+			if (!commandPool || commandBuffers.empty())
+			{
+				throw std::runtime_error(
+					"Could not allocate vk::CommandBuffer(s). Verify your hardware is supported, and your drivers are up-to-date.");
+			}
+			frameCommandPools_.emplace_back(std::move(commandPool));
+			commandBuffers_.emplace_back(std::move(commandBuffers[0]));
+		}
+	}
+
+	// One command pool per recording thread per frame in flight, so threads allocate and record secondary command
+	// buffers without synchronizing, and a frame's pools can be reset wholesale once its fence has been waited on.
+	void CreateSecondaryCommandPools(const uint32_t numThreads)
+	{
+		secondaryCommandBuffers_.clear();
+		secondaryCommandBuffers_.resize(maxFramesInFlight_);
+		for (auto& frame : secondaryCommandBuffers_)
+		{
+			for (uint32_t i = 0; i < numThreads; ++i)
+			{
+				frame.Pools.emplace_back(deviceContext_.LogicalDevice->createCommandPoolUnique({
+					vk::CommandPoolCreateFlagBits::eTransient, deviceContext_.GraphicsQueueFamily
+				}));
+			}
 		}
 	}
 
-	void BeginRenderPass(const uint32_t frameIndex)
+	// Resets the frame's secondary command buffers. Call before recording any of them, after the frame's fence has been
+	// waited on.
+	void BeginSecondaryCommandBuffers(const uint32_t frameIndex, const uint32_t imageIndex)
+	{
+		auto& frame = secondaryCommandBuffers_[frameIndex];
+		for (auto& pool : frame.Pools)
+		{
+			deviceContext_.LogicalDevice->resetCommandPool(pool.get(), {});
+		}
+		frame.Framebuffer = swapchainFramebuffers_[imageIndex].get();
+		frame.NumGroups = 0;
+	}
+
+	// Starts a new group of secondary command buffers, one per thread. Groups execute in the order they were added, so
+	// e.g. blended draws can be recorded in parallel, but still land after every opaque draw. Call from the render
+	// thread, while no other thread records.
+	void AddSecondaryCommandBufferGroup(const uint32_t frameIndex)
+	{
+		auto& frame = secondaryCommandBuffers_[frameIndex];
+		if (frame.NumGroups == frame.Groups.size())
+		{
+			SecondaryCommandBufferGroup group;
+			for (auto& pool : frame.Pools)
+			{
+				group.Buffers.emplace_back(std::move(deviceContext_.LogicalDevice->allocateCommandBuffersUnique({
+					pool.get(), vk::CommandBufferLevel::eSecondary, 1
+				})[0]));
+			}
+			group.Begun.resize(frame.Pools.size());
+			frame.Groups.emplace_back(std::move(group));
+		}
+
+		auto& group = frame.Groups[frame.NumGroups++];
+		std::fill(group.Begun.begin(), group.Begun.end(), static_cast<char>(false));
+	}
+
+	// The calling thread's command buffer in the current group, begun on first use. Every thread only ever touches its
+	// own buffer, so this is safe to call from any number of threads at once. Nothing is bound in a fresh buffer.
+	vk::UniqueCommandBuffer& GetSecondaryCommandBuffer(const uint32_t frameIndex, const uint32_t threadIndex)
+	{
+		auto& frame = secondaryCommandBuffers_[frameIndex];
+		auto& group = frame.Groups[frame.NumGroups - 1];
+		auto& buffer = group.Buffers[threadIndex];
+		if (!group.Begun[threadIndex])
+		{
+			const vk::CommandBufferInheritanceInfo inheritanceInfo(renderPass_.get(), 0, frame.Framebuffer);
+			buffer->begin({
+				vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+				&inheritanceInfo
+			});
+			group.Begun[threadIndex] = true;
+		}
+		return buffer;
+	}
+
+	// Commands that can't be recorded inside a render pass, like compute dispatches, go between BeginCommandBuffer() and
+	// BeginRenderPass().
+	void BeginCommandBuffer(const uint32_t frameIndex)
+	{
+		commandBuffers_[frameIndex]->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+	}
+
+	void BeginRenderPass(const uint32_t frameIndex, const uint32_t imageIndex)
 	{
 		auto& buffer = commandBuffers_[frameIndex];
-		vk::CommandBufferBeginInfo commandBufferBeginInfo;
-		buffer->reset({});
-		buffer->begin(&commandBufferBeginInfo);
 		const std::array<vk::ClearValue, 2> clearValues = {
 			vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f}), vk::ClearDepthStencilValue(1.0f, 0.0f)
 		};
-		vk::RenderPassBeginInfo renderPassBeginInfo(*renderPass_, swapchainFramebuffers_[frameIndex].get(),
+		vk::RenderPassBeginInfo renderPassBeginInfo(*renderPass_, swapchainFramebuffers_[imageIndex].get(),
 		                                            {{0, 0}, swapchainExtent_}, clearValues.size(), &clearValues[0]);
 
-		buffer->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-		buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *graphicsPipeline_);
-		
+		// Draws are all recorded into secondary command buffers, see GetSecondaryCommandBuffer().
+		buffer->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+		std::vector<vk::CommandBuffer> secondaryCommandBuffers;
+		auto& frame = secondaryCommandBuffers_[frameIndex];
+		for (uint32_t i = 0; i < frame.NumGroups; ++i)
+		{
+			auto& group = frame.Groups[i];
+			for (size_t thread = 0; thread < group.Buffers.size(); ++thread)
+			{
+				if (group.Begun[thread])
+				{
+					group.Buffers[thread]->end();
+					secondaryCommandBuffers.emplace_back(group.Buffers[thread].get());
+				}
+			}
+		}
+
+		if (!secondaryCommandBuffers.empty())
+		{
+			buffer->executeCommands(secondaryCommandBuffers);
+		}
+	}
+
+	void BindGraphicsPipeline(vk::UniqueCommandBuffer& commandBuffer)
+	{
+		commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *graphicsPipeline_);
+	}
+
+	void BindParticlePipeline(vk::UniqueCommandBuffer& commandBuffer)
+	{
+		commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *particlePipeline_);
+	}
+
+	void BindComputePipeline(const uint32_t frameIndex)
+	{
+		commandBuffers_[frameIndex]->bindPipeline(vk::PipelineBindPoint::eCompute, *computePipeline_);
 	}
 
 	void EndRenderPass(const uint32_t frameIndex)
@@ -530,19 +684,30 @@ public:
 		deviceContext_.LogicalDevice->waitIdle();
 	}
 
-	void WaitForFences()
+	// Blocks until the GPU has finished the last submission of the given frame, so its resources can be reused.
+	void WaitForFences(const size_t frameIndex)
 	{
-		const auto result = deviceContext_.LogicalDevice->waitForFences(*inFlightFences_[0], VK_TRUE, UINT64_MAX);
+		const auto result = deviceContext_.LogicalDevice->waitForFences(*inFlightFences_[frameIndex], VK_TRUE, UINT64_MAX);
 		
 		if (result != vk::Result::eSuccess)
 		{
 			throw std::runtime_error("Could not wait for Vulkan fences.");
 		}
+
+		deviceContext_.LogicalDevice->resetCommandPool(frameCommandPools_[frameIndex].get(), {});
+		deviceContext_.Transfers->Collect();
+		uniformBuffer_->Reset(static_cast<uint32_t>(frameIndex));
+	}
+
+	vk::Fence GetInFlightFence(const size_t frameIndex) const
+	{
+		return inFlightFences_[frameIndex].get();
 	}
 
-	void UpdateUniformBuffer(const uint32_t index, const vk::DeviceSize offset, const vk::DeviceSize size, const void* data)
+	// Appends uniform data for the given frame. Returns the dynamic offset to bind descriptor sets that read it with.
+	uint32_t PushUniformData(const uint32_t frameIndex, const void* data, const vk::DeviceSize size)
 	{
-		uniformBuffers_[index]->Fill(offset, size, data);
+		return uniformBuffer_->Push(frameIndex, data, size);
 	}
 
 	uint32_t AddDescriptorSetLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings)
@@ -567,6 +732,12 @@ public:
 		return descriptorSets_.size() - 1;
 	}
 
+	uint32_t AddComputeDescriptorSet()
+	{
+		descriptorSets_.emplace_back(std::make_shared<DescriptorSet>(deviceContext_, descriptorPool_, maxFramesInFlight_, computeDescriptorSetLayout_.get()));
+		return descriptorSets_.size() - 1;
+	}
+
 	std::shared_ptr<DescriptorSet> GetDescriptorSet(const uint32_t index)
 	{
 		return descriptorSets_[index];
@@ -603,8 +774,10 @@ public:
 		vk::Semaphore waitSemaphores[] = { imageAvailableSemaphores_[frameIndex].get() };
 		vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
 		vk::Semaphore signalSemaphores[] = { renderFinishedSemaphores_[frameIndex].get() };
-		vk::CommandBuffer commandBuffers[] = { commandBuffers_[imageIndex].get() };
+		vk::CommandBuffer commandBuffers[] = { commandBuffers_[frameIndex].get() };
 		const vk::SubmitInfo submitInfo(1, waitSemaphores, waitStages, 1, commandBuffers, 1, signalSemaphores);
+		// Uploads recorded since the last frame are submitted ahead of it, on the same queue, so the frame sees them.
+		deviceContext_.Transfers->Flush();
 		deviceContext_.GraphicsQueue->submit(submitInfo, inFlightFences_[frameIndex].get());
 		presentSwapchain_(submitInfo.pSignalSemaphores[0], imageIndex);
 	}
@@ -613,18 +786,13 @@ public:
 	{
 		swapchainFramebuffers_.clear();
 		commandBuffers_.clear();
+		frameCommandPools_.clear();
 
+		particlePipeline_.reset();
 		graphicsPipeline_.reset();
 		graphicsPipelineLayout_.reset();
 		renderPass_.reset();
 
-		uniformBuffers_.clear();
-		
-		// for (size_t i = 0; i < uniformBuffers_.size(); i++)
-		// {
-		// 	uniformBuffers_[i].reset();
-		// }
-
 		// TODO: [zpuls 2020-07-31T18:16] Add better error handling to VulkanContext::DestroySwapchain(). \
 											Namely, not attempting to delete/destroy objects that don't exist.
 
@@ -637,24 +805,37 @@ public:
 
 	void UpdateMesh(const uint32_t frameIndex, std::shared_ptr<Mesh> mesh, std::shared_ptr<Texture> texture)
 	{
-		auto descriptorBufferInfo = mesh->GetUniformBuffer(frameIndex)->GenerateDescriptorBufferInfo();
+		auto descriptorBufferInfo = uniformBuffer_->GenerateDescriptorBufferInfo(sizeof(glm::mat4) * 2);
 		auto descriptorImageInfo = texture->GenerateDescriptorImageInfo();
 		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
-			{nullptr, 0, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &descriptorBufferInfo},
+			{nullptr, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, {}, &descriptorBufferInfo},
 			{nullptr, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &descriptorImageInfo}
 		};
-		descriptorSets_[mesh->GetDescriptorSetIndex()]->Update(descriptorWrites);
+		descriptorSets_[mesh->GetDescriptorSetIndex()]->Update(frameIndex, descriptorWrites);
 	}
 
 	void UpdateParticleEffect(const uint32_t frameIndex, std::shared_ptr<ParticleEffect> particleEffect, std::shared_ptr<Texture> texture)
 	{
-		auto descriptorBufferInfo = particleEffect->GetUniformBuffer(frameIndex)->GenerateDescriptorBufferInfo();
+		auto descriptorBufferInfo = uniformBuffer_->GenerateDescriptorBufferInfo(sizeof(glm::mat4) * 2);
 		auto descriptorImageInfo = texture->GenerateDescriptorImageInfo();
 		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
-			{ nullptr, 0, 0, 1, vk::DescriptorType::eUniformBuffer, {}, &descriptorBufferInfo },
+			{ nullptr, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, {}, &descriptorBufferInfo },
 			{ nullptr, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &descriptorImageInfo }
 		};
-		descriptorSets_[particleEffect->GetDescriptorSetIndex()]->Update(descriptorWrites);
+		descriptorSets_[particleEffect->GetDescriptorSetIndex()]->Update(frameIndex, descriptorWrites);
+
+		if (particleEffect->GetRenderMode() == ParticleEffect::RenderMode::Compute)
+		{
+			auto stateBufferInfo = particleEffect->GetStateBuffer()->GenerateDescriptorBufferInfo();
+			auto instanceBufferInfo = particleEffect->GetInstanceBuffer()->GenerateDescriptorBufferInfo();
+			auto spawnCounterBufferInfo = particleEffect->GetSpawnCounterBuffer()->GenerateDescriptorBufferInfo();
+			std::vector<vk::WriteDescriptorSet> computeDescriptorWrites = {
+				{ nullptr, 0, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &stateBufferInfo },
+				{ nullptr, 1, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &instanceBufferInfo },
+				{ nullptr, 2, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &spawnCounterBufferInfo }
+			};
+			descriptorSets_[particleEffect->GetComputeDescriptorSetIndex()]->Update(frameIndex, computeDescriptorWrites);
+		}
 	}
 
 	vk::UniqueCommandBuffer& GetCommandBuffer(const uint32_t index)
@@ -666,6 +847,11 @@ public:
 	{
 		return graphicsPipelineLayout_;
 	}
+
+	vk::UniquePipelineLayout& GetComputePipelineLayout()
+	{
+		return computePipelineLayout_;
+	}
 private:
 	vk::UniqueInstance instance_;
 	std::vector<const char*> enabledLayers_;
@@ -682,10 +868,35 @@ private:
 	std::vector<std::shared_ptr<DescriptorSet>> descriptorSets_;
 	vk::UniquePipelineLayout graphicsPipelineLayout_;
 	vk::UniquePipeline graphicsPipeline_;
+	vk::UniquePipeline particlePipeline_;
+	vk::UniqueDescriptorSetLayout computeDescriptorSetLayout_;
+	vk::UniquePipelineLayout computePipelineLayout_;
+	vk::UniquePipeline computePipeline_;
 	std::vector<vk::UniqueFramebuffer> swapchainFramebuffers_;
 	vk::UniqueCommandPool commandPool_;
+	// Indexed by frame in flight, like commandBuffers_, which are allocated from them.
+	std::vector<vk::UniqueCommandPool> frameCommandPools_;
 	std::vector<vk::UniqueCommandBuffer> commandBuffers_;
-	std::vector<std::shared_ptr<GenericBuffer>> uniformBuffers_;
+
+	struct SecondaryCommandBufferGroup
+	{
+		// Indexed by thread.
+		std::vector<vk::UniqueCommandBuffer> Buffers;
+		std::vector<char> Begun;
+	};
+
+	struct SecondaryCommandBuffers
+	{
+		// Indexed by thread. Destroyed after Groups, which are allocated from them.
+		std::vector<vk::UniqueCommandPool> Pools;
+		std::vector<SecondaryCommandBufferGroup> Groups;
+		uint32_t NumGroups = 0;
+		vk::Framebuffer Framebuffer;
+	};
+
+	// Indexed by frame in flight.
+	std::vector<SecondaryCommandBuffers> secondaryCommandBuffers_;
+	std::shared_ptr<DynamicUniformBuffer> uniformBuffer_;
 	std::vector<vk::UniqueSemaphore> imageAvailableSemaphores_;
 	std::vector<vk::UniqueSemaphore> renderFinishedSemaphores_;
 	std::vector<vk::UniqueFence> inFlightFences_;
@@ -697,10 +908,17 @@ private:
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME
 	};
 
+	inline static const uint32_t MAX_DESCRIPTOR_SETS = 64;
+	// Uniform data each frame can push, 4096 pushes at the largest minUniformBufferOffsetAlignment.
+	inline static const vk::DeviceSize MAX_UNIFORM_DATA_PER_FRAME = 4096 * 256;
+
 	struct QueueFamilyIndices
 	{
 		std::optional<uint32_t> GraphicsFamily;
 		std::optional<uint32_t> PresentFamily;
+		// A family without graphics support, so uploads submitted to it can overlap rendering. Empty if the device has
+		// none, in which case they go to the graphics family.
+		std::optional<uint32_t> TransferFamily;
 
 		bool IsComplete()
 		{
@@ -749,19 +967,30 @@ private:
 		uint32_t i = 0;
 		for (const auto& queueFamily : queueFamilies)
 		{
-			if (queueFamily.queueCount > 0 && queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)
+			if (queueFamily.queueCount == 0)
+			{
+				i++;
+				continue;
+			}
+
+			const auto hasGraphics = static_cast<bool>(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics);
+			const auto hasCompute = static_cast<bool>(queueFamily.queueFlags & vk::QueueFlagBits::eCompute);
+			const auto hasTransfer = static_cast<bool>(queueFamily.queueFlags & vk::QueueFlagBits::eTransfer);
+
+			if (!indices.GraphicsFamily.has_value() && hasGraphics)
 			{
 				indices.GraphicsFamily = i;
 			}
 
-			if (queueFamily.queueCount > 0 && physicalDevice.getSurfaceSupportKHR(i, surface_.get()))
+			if (!indices.PresentFamily.has_value() && physicalDevice.getSurfaceSupportKHR(i, surface_.get()))
 			{
 				indices.PresentFamily = i;
 			}
 
-			if (indices.IsComplete())
+			// Prefer a transfer-only family (the DMA engines on discrete GPUs), fall back to an async compute family.
+			if (!hasGraphics && hasTransfer && (!indices.TransferFamily.has_value() || !hasCompute))
 			{
-				break;
+				indices.TransferFamily = i;
 			}
 
 			i++;
@@ -832,6 +1061,74 @@ private:
 		return actualExtent;
 	}
 
+	vk::UniquePipeline createGraphicsPipeline_(const std::stringstream& vertexShaderSource,
+	                                           const std::stringstream& fragmentShaderSource,
+	                                           const std::vector<vk::VertexInputBindingDescription>&
+	                                           vertexInputBindingDescriptions,
+	                                           const std::vector<vk::VertexInputAttributeDescription>&
+	                                           vertexInputAttributeDescriptions, const float minDepth,
+	                                           const float maxDepth) const
+	{
+		auto vertexShaderModule = createShaderModule_(vertexShaderSource);
+		auto fragmentShaderModule = createShaderModule_(fragmentShaderSource);
+
+		vk::PipelineShaderStageCreateInfo vertexShaderPipelineShaderStageCreateInfo(
+			{}, vk::ShaderStageFlagBits::eVertex, vertexShaderModule.get(), "main");
+
+		vk::PipelineShaderStageCreateInfo fragmentShaderPipelineShaderStageCreateInfo(
+			{}, vk::ShaderStageFlagBits::eFragment, fragmentShaderModule.get(), "main");
+
+		vk::PipelineShaderStageCreateInfo pipelineShaderStageCreateInfos[] = {
+			vertexShaderPipelineShaderStageCreateInfo, fragmentShaderPipelineShaderStageCreateInfo
+		};
+		vk::PipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo(
+			{}, static_cast<uint32_t>(vertexInputBindingDescriptions.size()), &vertexInputBindingDescriptions[0],
+			static_cast<uint32_t>(vertexInputAttributeDescriptions.size()), &vertexInputAttributeDescriptions[0]);
+		vk::PipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo(
+			{}, vk::PrimitiveTopology::eTriangleList);
+		vk::Viewport viewport(0.0f, 0.0f, static_cast<float>(swapchainExtent_.width),
+			static_cast<float>(swapchainExtent_.height), minDepth, maxDepth);
+		vk::Rect2D scissor({ 0, 0 }, swapchainExtent_);
+		vk::PipelineViewportStateCreateInfo pipelineViewportStateCreateInfo({}, 1, &viewport, 1, &scissor);
+		vk::PipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo(
+			{}, VK_FALSE, VK_FALSE, vk::PolygonMode::eFill, vk::CullModeFlagBits::eBack,
+			vk::FrontFace::eCounterClockwise,
+			VK_FALSE, 0.0f, 0.0f, 0.0f, 1.0f);
+		vk::PipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo(
+			{}, vk::SampleCountFlagBits::e1, VK_FALSE);
+		vk::PipelineDepthStencilStateCreateInfo pipelineDepthStencilStateCreateInfo({}, VK_TRUE, VK_TRUE, vk::CompareOp::eLess, VK_FALSE, VK_FALSE, {}, {}, 0.0f, 1.0f);
+		vk::PipelineColorBlendAttachmentState pipelineColorBlendAttachmentState(VK_FALSE, {}, {}, {}, {}, {}, {},
+			vk::ColorComponentFlagBits::eR | vk::
+			ColorComponentFlagBits::eG | vk::
+			ColorComponentFlagBits::eB | vk::
+			ColorComponentFlagBits::eA);
+		vk::PipelineColorBlendStateCreateInfo pipelineColorBlendStateCreateInfo(
+			{}, VK_FALSE, vk::LogicOp::eCopy, 1, &pipelineColorBlendAttachmentState);
+
+		auto pipeline = deviceContext_.LogicalDevice->createGraphicsPipelineUnique(nullptr, {
+			                                                                               {}, 2,
+			                                                                               pipelineShaderStageCreateInfos,
+			                                                                               &pipelineVertexInputStateCreateInfo,
+			                                                                               &pipelineInputAssemblyStateCreateInfo,
+			                                                                               nullptr,
+			                                                                               &pipelineViewportStateCreateInfo,
+			                                                                               &pipelineRasterizationStateCreateInfo,
+			                                                                               &pipelineMultisampleStateCreateInfo,
+			                                                                               &pipelineDepthStencilStateCreateInfo,
+			                                                                               &pipelineColorBlendStateCreateInfo,
+			                                                                               nullptr,
+			                                                                               *graphicsPipelineLayout_,
+			                                                                               *renderPass_
+		                                                                               });
+		if (!pipeline)
+		{
+			throw std::runtime_error(
+				"Could not create vk::Pipeline for the Vulkan graphics pipeline. Verify your hardware is supported, and your drivers are up-to-date.");
+		}
+
+		return pipeline;
+	}
+
 	vk::UniqueShaderModule createShaderModule_(const std::stringstream& code) const
 	{
 		const auto codeString = code.str();
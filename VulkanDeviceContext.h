@@ -2,10 +2,23 @@
 
 #include "stdafx.h"
 
+class MemoryAllocator;
+class SamplerCache;
+class StagingRing;
+class TransferManager;
+
 struct VulkanDeviceContext
 {
 	std::shared_ptr<vk::PhysicalDevice> PhysicalDevice;
 	std::shared_ptr<vk::Device> LogicalDevice;
 	std::shared_ptr<vk::Queue> GraphicsQueue;
 	std::shared_ptr<vk::Queue> PresentQueue;
+	// The same queue as GraphicsQueue, on devices without a dedicated transfer queue family.
+	std::shared_ptr<vk::Queue> TransferQueue;
+	uint32_t GraphicsQueueFamily = 0;
+	uint32_t TransferQueueFamily = 0;
+	std::shared_ptr<MemoryAllocator> Allocator;
+	std::shared_ptr<TransferManager> Transfers;
+	std::shared_ptr<StagingRing> Staging;
+	std::shared_ptr<SamplerCache> Samplers;
 };
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "JobSystem.h"
 #include "ParticleEffect.h"
 #include "Scene.h"
 #include "stdafx.h"
@@ -8,15 +9,19 @@
 class VulkanRenderingEngine
 {
 public:
-	VulkanRenderingEngine(std::shared_ptr<VulkanContext> context, const uint32_t maxFramesInFlight)
+	VulkanRenderingEngine(std::shared_ptr<VulkanContext> context, const uint32_t maxFramesInFlight,
+	                      std::shared_ptr<JobSystem> jobSystem = nullptr)
 		: context_(context),
-		  maxFramesInFlight_(maxFramesInFlight)
+		  maxFramesInFlight_(maxFramesInFlight),
+		  jobSystem_(jobSystem != nullptr ? jobSystem : std::make_shared<JobSystem>()),
+		  boundTextureGenerations_(maxFramesInFlight, 0)
 	{
+		context_->CreateSecondaryCommandPools(jobSystem_->GetNumWorkers() + 1);
 	}
 
 	uint32_t BeginFrame(const vk::Extent2D currentSwapchainExtent)
 	{
-		context_->WaitForFences();
+		context_->WaitForFences(currentFrame_);
 
 		uint32_t imageIndex;
 		const auto result = context_->AcquireNextImage(currentFrame_, imageIndex);
@@ -31,7 +36,7 @@ public:
 			throw std::runtime_error("Could not acquire Vulkan swapchain image.");
 		}
 
-		context_->BeginRenderPass(currentFrame_);
+		context_->BeginCommandBuffer(currentFrame_);
 		
 		return imageIndex;
 	}
@@ -40,8 +45,19 @@ public:
 	{
 		scene->SetSwapchainExtent(context_->GetSwapchainExtent());
 
+		// The frame's fence has been waited on, so its descriptor sets can be pointed at newly loaded textures.
+		scene->ResolveTextures();
+		if (boundTextureGenerations_[currentFrame_] != scene->GetTextureGeneration())
+		{
+			UpdateSceneFrame(scene, static_cast<uint32_t>(currentFrame_));
+		}
+
 		UpdateSceneMeshes(scene, deltaTime);
-		RenderSceneObjects(scene);
+		SimulateParticleEffects(scene);
+		const auto viewProjection = scene->GetViewProjection();
+		viewProjectionOffset_ = context_->PushUniformData(currentFrame_, &viewProjection[0], sizeof(viewProjection));
+		RenderSceneObjects(scene, imageIndex);
+		context_->BeginRenderPass(currentFrame_, imageIndex);
 		
 		try
 		{
@@ -60,30 +76,75 @@ public:
 		}
 	}
 
+	// Points every frame's descriptor sets at that frame's uniform buffers.
 	void UpdateScene(std::shared_ptr<Scene> scene)
 	{
-		for (auto mesh : scene->GetMeshes())
-		{
-			context_->UpdateMesh(currentFrame_, mesh, scene->GetTexture(mesh->GetTextureIndex()));
-		}
-
-		for (auto particleEffect : scene->GetParticleEffects())
+		for (uint32_t frameIndex = 0; frameIndex < maxFramesInFlight_; ++frameIndex)
 		{
-			context_->UpdateParticleEffect(currentFrame_, particleEffect, scene->GetTexture(particleEffect->GetTextureIndex()));
+			UpdateSceneFrame(scene, frameIndex);
 		}
 	}
 
-	void RenderSceneObjects(std::shared_ptr<Scene> scene)
+	// Only call while the GPU isn't using the frame's descriptor sets.
+	void UpdateSceneFrame(std::shared_ptr<Scene> scene, const uint32_t frameIndex)
 	{
 		for (auto mesh : scene->GetMeshes())
 		{
-			RenderMesh(mesh, scene->GetMVP(mesh));
+			context_->UpdateMesh(frameIndex, mesh, scene->GetTexture(mesh->GetTextureIndex()));
 		}
 
 		for (auto particleEffect : scene->GetParticleEffects())
 		{
-			RenderParticleEffect(particleEffect, scene->GetMVP(particleEffect));
+			context_->UpdateParticleEffect(frameIndex, particleEffect, scene->GetTexture(particleEffect->GetTextureIndex()));
 		}
+		boundTextureGenerations_[frameIndex] = scene->GetTextureGeneration();
+	}
+
+	[[nodiscard]] std::shared_ptr<JobSystem> GetJobSystem() const
+	{
+		return jobSystem_;
+	}
+
+	// Draws are split into chunks that worker threads record into their own secondary command buffers. Meshes and
+	// particle effects are recorded as two groups, which keeps the scene's draw order of every mesh before any particle.
+	// Both pipelines are opaque and depth tested, so the order only affects overdraw, not the image.
+	void RenderSceneObjects(std::shared_ptr<Scene> scene, const uint32_t imageIndex)
+	{
+		const auto frameIndex = static_cast<uint32_t>(currentFrame_);
+		context_->BeginSecondaryCommandBuffers(frameIndex, imageIndex);
+
+		const auto meshes = scene->GetMeshes();
+		context_->AddSecondaryCommandBufferGroup(frameIndex);
+		JobSystem::Counter meshCounter;
+		jobSystem_->ParallelFor(0, static_cast<uint32_t>(meshes.size()), DRAWS_PER_JOB,
+		                        [this, &scene, &meshes, frameIndex](const uint32_t begin, const uint32_t end)
+		                        {
+			                        auto& commandBuffer = context_->GetSecondaryCommandBuffer(
+				                        frameIndex, jobSystem_->GetCurrentThreadIndex());
+			                        context_->BindGraphicsPipeline(commandBuffer);
+			                        for (auto i = begin; i < end; ++i)
+			                        {
+				                        RenderMesh(commandBuffer, meshes[i], scene->GetModelMatrix(meshes[i]));
+			                        }
+		                        }, meshCounter);
+		jobSystem_->Wait(meshCounter);
+
+		const auto particleEffects = scene->GetParticleEffects();
+		context_->AddSecondaryCommandBufferGroup(frameIndex);
+		JobSystem::Counter particleEffectCounter;
+		jobSystem_->ParallelFor(0, static_cast<uint32_t>(particleEffects.size()), DRAWS_PER_JOB,
+		                        [this, &scene, &particleEffects, frameIndex](const uint32_t begin, const uint32_t end)
+		                        {
+			                        auto& commandBuffer = context_->GetSecondaryCommandBuffer(
+				                        frameIndex, jobSystem_->GetCurrentThreadIndex());
+			                        for (auto i = begin; i < end; ++i)
+			                        {
+				                        RenderParticleEffect(commandBuffer, particleEffects[i],
+				                                             scene->GetModelMatrix(particleEffects[i]),
+				                                             i > begin ? particleEffects[i - 1] : nullptr);
+			                        }
+		                        }, particleEffectCounter);
+		jobSystem_->Wait(particleEffectCounter);
 	}
 
 	void UpdateSceneMeshes(std::shared_ptr<Scene> scene, const float deltaTime)
@@ -93,9 +154,35 @@ public:
 			mesh->Update(deltaTime);
 		}
 
+		// Effects are independent of each other, so each one gets its own job, which in turn splits its particles
+		// into chunks.
+		const auto frameIndex = static_cast<uint32_t>(currentFrame_);
+		JobSystem::Counter counter;
+		for (auto particleEffect : scene->GetParticleEffects())
+		{
+			jobSystem_->Submit([this, particleEffect, deltaTime, frameIndex]
+			{
+				particleEffect->Update(deltaTime, frameIndex, *jobSystem_);
+			}, counter);
+		}
+		jobSystem_->Wait(counter);
+	}
+
+	// Compute dispatches can't be recorded inside a render pass, so this runs between BeginFrame() and the render pass.
+	void SimulateParticleEffects(std::shared_ptr<Scene> scene)
+	{
+		auto& commandBuffer = context_->GetCommandBuffer(currentFrame_);
 		for (auto particleEffect : scene->GetParticleEffects())
 		{
-			particleEffect->Update(deltaTime);
+			if (particleEffect->GetRenderMode() != ParticleEffect::RenderMode::Compute)
+			{
+				continue;
+			}
+
+			context_->BindComputePipeline(currentFrame_);
+			context_->GetDescriptorSet(particleEffect->GetComputeDescriptorSetIndex())->Bind(
+				currentFrame_, context_->GetComputePipelineLayout(), commandBuffer, vk::PipelineBindPoint::eCompute);
+			particleEffect->Dispatch(commandBuffer, context_->GetComputePipelineLayout());
 		}
 	}
 
@@ -105,24 +192,55 @@ public:
 	}
 
 	// TODO: [zpuls 2020-08-08T17:40] Should I allow dynamic pipeline binding per mesh/shader/material/etc?
-	void RenderMesh(std::shared_ptr<Mesh> mesh, std::array<glm::mat4, 3> mvp)
+	void RenderMesh(vk::UniqueCommandBuffer& commandBuffer, std::shared_ptr<Mesh> mesh, const glm::mat4& modelMatrix)
 	{
-		auto& commandBuffer = context_->GetCommandBuffer(currentFrame_);
-		mesh->BindMeshData(currentFrame_, commandBuffer, mvp);
-		context_->GetDescriptorSet(mesh->GetDescriptorSetIndex())->Bind(currentFrame_, context_->GetGraphicsPipelineLayout(), commandBuffer);
+		mesh->BindMeshData(currentFrame_, commandBuffer);
+		context_->GetDescriptorSet(mesh->GetDescriptorSetIndex())->Bind(currentFrame_, context_->GetGraphicsPipelineLayout(), commandBuffer, vk::PipelineBindPoint::eGraphics, viewProjectionOffset_);
+		commandBuffer->pushConstants<glm::mat4>(context_->GetGraphicsPipelineLayout().get(), vk::ShaderStageFlagBits::eVertex, 0, modelMatrix);
 		mesh->Draw(commandBuffer);
 	}
 
-	void RenderParticleEffect(std::shared_ptr<ParticleEffect> particleEffect, std::array<glm::mat4, 3> mvp)
+	// previous is the effect last drawn into commandBuffer, if any. Effects that share its pipeline and descriptor set,
+	// e.g. sprites from one TextureAtlas, don't rebind them.
+	void RenderParticleEffect(vk::UniqueCommandBuffer& commandBuffer, std::shared_ptr<ParticleEffect> particleEffect,
+	                          const glm::mat4& modelMatrix, const std::shared_ptr<ParticleEffect>& previous = nullptr)
 	{
-		auto& commandBuffer = context_->GetCommandBuffer(currentFrame_);
-		particleEffect->BindMeshData(currentFrame_, commandBuffer, mvp);
-		context_->GetDescriptorSet(particleEffect->GetDescriptorSetIndex())->Bind(currentFrame_, context_->GetGraphicsPipelineLayout(), commandBuffer);
+		const auto usesVertices = [](const std::shared_ptr<ParticleEffect>& effect)
+		{
+			return effect->GetRenderMode() == ParticleEffect::RenderMode::Vertices;
+		};
+
+		if (previous == nullptr || usesVertices(previous) != usesVertices(particleEffect))
+		{
+			if (!usesVertices(particleEffect))
+			{
+				context_->BindParticlePipeline(commandBuffer);
+			}
+			else
+			{
+				context_->BindGraphicsPipeline(commandBuffer);
+			}
+		}
+		particleEffect->BindMeshData(currentFrame_, commandBuffer);
+		if (previous == nullptr || previous->GetDescriptorSetIndex() != particleEffect->GetDescriptorSetIndex())
+		{
+			context_->GetDescriptorSet(particleEffect->GetDescriptorSetIndex())->Bind(currentFrame_, context_->GetGraphicsPipelineLayout(), commandBuffer, vk::PipelineBindPoint::eGraphics, viewProjectionOffset_);
+		}
+		commandBuffer->pushConstants<glm::mat4>(context_->GetGraphicsPipelineLayout().get(), vk::ShaderStageFlagBits::eVertex, 0, modelMatrix);
 		particleEffect->Draw(commandBuffer);
+		particleEffect->Release(currentFrame_, context_->GetInFlightFence(currentFrame_));
 	}
 
 private:
 	std::shared_ptr<VulkanContext> context_;
 	const uint32_t maxFramesInFlight_;
+	std::shared_ptr<JobSystem> jobSystem_;
+	// Indexed by frame in flight, the Scene::GetTextureGeneration() its descriptor sets were last written with.
+	std::vector<uint64_t> boundTextureGenerations_;
 	size_t currentFrame_ = 0;
+	// Dynamic offset of the current frame's view and projection matrices.
+	uint32_t viewProjectionOffset_ = 0;
+
+	// Large enough that recording a chunk outweighs the cost of scheduling its job.
+	static const inline uint32_t DRAWS_PER_JOB = 64;
 };
@@ -1,4 +1,6 @@
 @echo off
 C:\VulkanSDK\1.1.121.2\Bin\glslc.exe main.vert -o vert.spv
 C:\VulkanSDK\1.1.121.2\Bin\glslc.exe main.frag -o frag.spv
+C:\VulkanSDK\1.1.121.2\Bin\glslc.exe particle.vert -o particle_vert.spv
+C:\VulkanSDK\1.1.121.2\Bin\glslc.exe particle.comp -o particle_comp.spv
 pause
\ No newline at end of file
@@ -8,14 +8,19 @@ layout(location = 2) in vec2 inTexCoord;
 layout(location = 0) out vec4 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
-layout(binding = 0) uniform ModelViewProj {
-    mat4 model;
+// Per-frame, shared by every draw.
+layout(binding = 0) uniform ViewProj {
     mat4 view;
     mat4 proj;
-} mvp;
+} camera;
+
+// Per-draw.
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+} object;
 
 void main() {
-    gl_Position = mvp.proj * mvp.view * mvp.model * vec4(inPosition, 1.0);
+    gl_Position = camera.proj * camera.view * object.model * vec4(inPosition, 1.0);
     fragColor = inColor;
 	fragTexCoord = inTexCoord;
 }
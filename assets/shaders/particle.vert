@@ -0,0 +1,33 @@
+#version 460
+#extension GL_ARB_separate_shader_objects : enable
+
+// Unit quad, shared by every particle.
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec4 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+// Per-instance particle data.
+layout(location = 3) in vec3 instancePosition;
+layout(location = 4) in float instanceSize;
+layout(location = 5) in vec4 instanceColor;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+// Per-frame, shared by every draw.
+layout(binding = 0) uniform ViewProj {
+    mat4 view;
+    mat4 proj;
+} camera;
+
+// Per-draw.
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+} object;
+
+void main() {
+    vec3 position = instancePosition + inPosition * instanceSize;
+    gl_Position = camera.proj * camera.view * object.model * vec4(position, 1.0);
+    fragColor = instanceColor;
+	fragTexCoord = inTexCoord;
+}
@@ -1,8 +1,34 @@
 #include "stdafx.h"
 #include "Application.h"
+#include "TextureCooker.h"
 
-int main() {
+// VulkanParticles --cook-texture <source image> <destination .vptx> [--no-mipmaps] [--format rgba8|bc1|bc3|bc7]
+// [--mip-filter box|kaiser] cooks a texture offline, see TextureCooker, instead of running the app.
+int main(int argc, char* argv[]) {
 	try {
+		if (argc >= 4 && std::string(argv[1]) == "--cook-texture") {
+			auto generateMipmaps = true;
+			auto format = vk::Format::eR8G8B8A8Unorm;
+			auto mipFilter = MipGenerator::Filter::Kaiser;
+			for (auto i = 4; i < argc; ++i) {
+				const std::string argument = argv[i];
+				if (argument == "--no-mipmaps") {
+					generateMipmaps = false;
+				}
+				else if (argument == "--format" && i + 1 < argc) {
+					format = TextureCooker::ParseFormat(argv[++i]);
+				}
+				else if (argument == "--mip-filter" && i + 1 < argc) {
+					mipFilter = TextureCooker::ParseMipFilter(argv[++i]);
+				}
+				else {
+					throw std::runtime_error("Unknown --cook-texture argument [" + argument + "].");
+				}
+			}
+			TextureCooker::Cook(argv[2], argv[3], generateMipmaps, format, mipFilter);
+			return 0;
+		}
+
 		Application particlesApp;
 		particlesApp.Run();
 	}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "Test.h"
+#include "BlockCompression.h"
+
+#include <cstdlib>
+
+namespace BlockCompressionTests
+{
+	// Fades from opaque red in the first column to opaque green in the last. Red and green vary in opposite directions,
+	// so the covariance of the block maps (1, 1, 1) to zero.
+	static BlockCompression::Block redToGreen_()
+	{
+		BlockCompression::Block block{};
+		for (uint32_t texel = 0; texel < 16; ++texel)
+		{
+			const auto x = texel % 4;
+			block[texel * 4 + 0] = static_cast<unsigned char>(255 - x * 85);
+			block[texel * 4 + 1] = static_cast<unsigned char>(x * 85);
+			block[texel * 4 + 2] = 0;
+			block[texel * 4 + 3] = 255;
+		}
+		return block;
+	}
+
+	static std::array<int, 3> fromRgb565_(const uint32_t color)
+	{
+		const auto r = color >> 11 & 31;
+		const auto g = color >> 5 & 63;
+		const auto b = color & 31;
+		return {static_cast<int>(r << 3 | r >> 2), static_cast<int>(g << 2 | g >> 4), static_cast<int>(b << 3 | b >> 2)};
+	}
+
+	// Decodes the RGB of a four-color BC1 block.
+	static BlockCompression::Block decodeBC1_(const unsigned char* in)
+	{
+		const auto color0 = static_cast<uint32_t>(in[0] | in[1] << 8);
+		const auto color1 = static_cast<uint32_t>(in[2] | in[3] << 8);
+		CHECK(color0 > color1);
+
+		std::array<std::array<int, 3>, 4> palette = {fromRgb565_(color0), fromRgb565_(color1)};
+		for (size_t c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		const auto indices = static_cast<uint32_t>(in[4] | in[5] << 8 | in[6] << 16 | in[7] << 24);
+		BlockCompression::Block block{};
+		for (uint32_t texel = 0; texel < 16; ++texel)
+		{
+			const auto& color = palette[indices >> (texel * 2) & 3];
+			for (size_t c = 0; c < 3; ++c)
+			{
+				block[texel * 4 + c] = static_cast<unsigned char>(color[c]);
+			}
+			block[texel * 4 + 3] = 255;
+		}
+		return block;
+	}
+
+	static uint32_t readBits_(const unsigned char* in, uint32_t& bit, const uint32_t count)
+	{
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < count; ++i, ++bit)
+		{
+			value |= static_cast<uint32_t>(in[bit / 8] >> (bit % 8) & 1) << i;
+		}
+		return value;
+	}
+
+	// Decodes a mode 6 BC7 block.
+	static BlockCompression::Block decodeBC7_(const unsigned char* in)
+	{
+		uint32_t bit = 0;
+		CHECK(readBits_(in, bit, 7) == 1 << 6);
+		std::array<std::array<uint32_t, 4>, 2> endpoints{};
+		for (size_t c = 0; c < 4; ++c)
+		{
+			endpoints[0][c] = readBits_(in, bit, 7);
+			endpoints[1][c] = readBits_(in, bit, 7);
+		}
+		for (auto& endpoint : endpoints)
+		{
+			const auto pBit = readBits_(in, bit, 1);
+			for (auto& channel : endpoint)
+			{
+				channel = channel << 1 | pBit;
+			}
+		}
+
+		static const std::array<uint32_t, 16> WEIGHTS = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+		BlockCompression::Block block{};
+		for (uint32_t texel = 0; texel < 16; ++texel)
+		{
+			const auto weight = WEIGHTS[readBits_(in, bit, texel == 0 ? 3 : 4)];
+			for (size_t c = 0; c < 4; ++c)
+			{
+				block[texel * 4 + c] = static_cast<unsigned char>(
+					((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+			}
+		}
+		return block;
+	}
+
+	static int maxError_(const BlockCompression::Block& expected, const BlockCompression::Block& actual)
+	{
+		auto error = 0;
+		for (size_t i = 0; i < expected.size(); ++i)
+		{
+			error = std::max(error, std::abs(static_cast<int>(expected[i]) - static_cast<int>(actual[i])));
+		}
+		return error;
+	}
+
+	// The four columns land on the four palette entries, so only endpoint quantization is left. Collapsing the block to
+	// its mean, as a zero principal axis does, is off by 128.
+	TEST_CASE(BC1EncodesRedToGreenGradient)
+	{
+		const auto block = redToGreen_();
+		std::array<unsigned char, 8> encoded{};
+		BlockCompression::EncodeBC1(block, encoded.data());
+		CHECK(maxError_(block, decodeBC1_(encoded.data())) <= 8);
+	}
+
+	TEST_CASE(BC7EncodesRedToGreenGradient)
+	{
+		const auto block = redToGreen_();
+		std::array<unsigned char, 16> encoded{};
+		BlockCompression::EncodeBC7(block, encoded.data());
+		CHECK(maxError_(block, decodeBC7_(encoded.data())) <= 4);
+	}
+
+	TEST_CASE(BC7EncodesUniformBlock)
+	{
+		BlockCompression::Block block{};
+		for (uint32_t texel = 0; texel < 16; ++texel)
+		{
+			block[texel * 4 + 0] = 200;
+			block[texel * 4 + 1] = 100;
+			block[texel * 4 + 2] = 50;
+			block[texel * 4 + 3] = 255;
+		}
+		std::array<unsigned char, 16> encoded{};
+		BlockCompression::EncodeBC7(block, encoded.data());
+		CHECK(maxError_(block, decodeBC7_(encoded.data())) <= 1);
+	}
+}
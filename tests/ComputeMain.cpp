@@ -0,0 +1,13 @@
+#include "stdafx.h"
+#include "Test.h"
+
+#include "ParticleComputeTests.h"
+
+// Tests for the parts of VulkanParticles that run on the GPU. They need no window, so any Vulkan device with a graphics
+// and compute queue works, including software implementations like lavapipe (point VK_ICD_FILENAMES at its ICD
+// manifest). Run from the repository root, so the shaders in assets/shaders are found. Exits with the number of failed
+// test cases.
+int main()
+{
+	return Test::RunAll();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Test.h"
+#include "JobSystem.h"
+
+#include <chrono>
+
+namespace JobSystemTests
+{
+	TEST_CASE(WaitRunsEveryJob)
+	{
+		JobSystem jobSystem(3);
+		std::vector<uint32_t> values(1000, 0);
+		JobSystem::Counter counter;
+		jobSystem.ParallelFor(0, static_cast<uint32_t>(values.size()), 7,
+		                      [&values](const uint32_t begin, const uint32_t end)
+		                      {
+			                      for (auto i = begin; i < end; ++i)
+			                      {
+				                      values[i] = i;
+			                      }
+		                      }, counter);
+		jobSystem.Wait(counter);
+
+		CHECK(counter.IsDone());
+		for (uint32_t i = 0; i < values.size(); ++i)
+		{
+			CHECK(values[i] == i);
+		}
+	}
+
+	// A chunk size of 0 would never advance past begin.
+	TEST_CASE(ParallelForRejectsEmptyChunks)
+	{
+		JobSystem jobSystem(1);
+		JobSystem::Counter counter;
+		auto threw = false;
+		try
+		{
+			jobSystem.ParallelFor(0, 16, 0, [](uint32_t, uint32_t) {}, counter);
+		}
+		catch (const std::invalid_argument&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+		CHECK(counter.IsDone());
+	}
+
+	// A throwing job must neither terminate the process nor release Wait() before the group's other jobs are done.
+	TEST_CASE(WaitRethrowsJobExceptionAfterEveryJob)
+	{
+		JobSystem jobSystem(3);
+		std::atomic<uint32_t> finished = 0;
+		auto caught = false;
+		{
+			JobSystem::Counter counter;
+			for (uint32_t i = 0; i < 64; ++i)
+			{
+				jobSystem.Submit([i, &finished]
+				{
+					if (i % 16 == 3)
+					{
+						throw std::runtime_error("Job " + std::to_string(i) + " failed.");
+					}
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+					finished.fetch_add(1);
+				}, counter);
+			}
+
+			try
+			{
+				jobSystem.Wait(counter);
+			}
+			catch (const std::runtime_error&)
+			{
+				caught = true;
+			}
+			CHECK(counter.IsDone());
+		}
+
+		CHECK(caught);
+		CHECK(finished.load() == 60);
+
+		// The exception was consumed, the JobSystem keeps working.
+		JobSystem::Counter counter;
+		jobSystem.Submit([&finished] { finished.fetch_add(1); }, counter);
+		jobSystem.Wait(counter);
+		CHECK(finished.load() == 61);
+	}
+
+	TEST_CASE(WaitRethrowsNestedJobException)
+	{
+		JobSystem jobSystem(2);
+		JobSystem::Counter counter;
+		jobSystem.Submit([&jobSystem]
+		{
+			JobSystem::Counter nestedCounter;
+			jobSystem.Submit([] { throw std::logic_error("Nested job failed."); }, nestedCounter);
+			jobSystem.Wait(nestedCounter);
+		}, counter);
+
+		auto caught = false;
+		try
+		{
+			jobSystem.Wait(counter);
+		}
+		catch (const std::logic_error&)
+		{
+			caught = true;
+		}
+		CHECK(caught);
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Test.h"
+#include "MipGenerator.h"
+
+#include <cstdlib>
+
+namespace MipGeneratorTests
+{
+	// Whether every byte of actual is within tolerance of expected. The SSE and scalar paths may round a texel apart.
+	static bool near_(const std::vector<unsigned char>& expected, const std::vector<unsigned char>& actual,
+	                  const int tolerance)
+	{
+		if (expected.size() != actual.size())
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < expected.size(); ++i)
+		{
+			if (std::abs(static_cast<int>(expected[i]) - static_cast<int>(actual[i])) > tolerance)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	TEST_CASE(BoxAveragesTwoByTwo)
+	{
+		const MipGenerator::Level source{{0, 200, 4, 255, 40, 100, 8, 255, 80, 20, 12, 255, 120, 0, 16, 255}, 2, 2};
+		const auto levels = MipGenerator::Generate(source.Pixels.data(), 2, 2, 2, MipGenerator::Filter::Box, false);
+
+		CHECK(levels.size() == 2);
+		CHECK(levels[0].Pixels == source.Pixels);
+		CHECK(levels[1].Width == 1);
+		CHECK(levels[1].Height == 1);
+		CHECK(levels[1].Pixels == std::vector<unsigned char>({60, 80, 10, 255}));
+	}
+
+	// Black and white average to half the light, which is 188 in sRGB, not 128. Alpha is always linear.
+	TEST_CASE(BoxAveragesInLinearSpace)
+	{
+		const MipGenerator::Level source{{0, 0, 0, 0, 255, 255, 255, 100, 255, 255, 255, 200, 0, 0, 0, 100}, 2, 2};
+		const auto level = MipGenerator::Downsample(source, MipGenerator::Filter::Box, true);
+
+		CHECK(level.Pixels == std::vector<unsigned char>({188, 188, 188, 100}));
+	}
+
+	// Decoding to linear and encoding back must not drift, for any value, or flat regions would shift color per level.
+	TEST_CASE(FlatImageRoundTripsThroughSrgb)
+	{
+		for (const auto filter : {MipGenerator::Filter::Box, MipGenerator::Filter::Kaiser})
+		{
+			for (uint32_t value = 0; value < 256; ++value)
+			{
+				MipGenerator::Level source{std::vector<unsigned char>(8 * 8 * 4), 8, 8};
+				for (size_t i = 0; i < source.Pixels.size(); ++i)
+				{
+					source.Pixels[i] = static_cast<unsigned char>(i % 4 == 3 ? 255 - value : value);
+				}
+
+				const auto level = MipGenerator::Downsample(source, filter, true);
+				CHECK(level.Width == 4);
+				CHECK(level.Height == 4);
+				CHECK(level.Pixels == std::vector<unsigned char>(source.Pixels.begin(),
+				                                                 source.Pixels.begin() + 4 * 4 * 4));
+			}
+		}
+	}
+
+	// An 8x8 image with a ramp in red and green, a checkerboard in blue and a falloff in alpha, against the 4x4 Kaiser
+	// output it was reviewed with.
+	TEST_CASE(KaiserMatchesReference)
+	{
+		MipGenerator::Level source{std::vector<unsigned char>(8 * 8 * 4), 8, 8};
+		for (uint32_t y = 0; y < 8; ++y)
+		{
+			for (uint32_t x = 0; x < 8; ++x)
+			{
+				auto* texel = &source.Pixels[(y * 8 + x) * 4];
+				texel[0] = static_cast<unsigned char>(x * 36);
+				texel[1] = static_cast<unsigned char>(y * 36);
+				texel[2] = (x + y) % 2 == 0 ? 0 : 255;
+				texel[3] = static_cast<unsigned char>(255 - x * y * 4);
+			}
+		}
+
+		static const std::vector<unsigned char> REFERENCE = {
+			26, 26, 184, 254, 93, 26, 187, 249, 164, 26, 187, 245, 233, 26, 190, 241,
+			26, 93, 188, 249, 93, 93, 187, 230, 164, 93, 187, 210, 233, 93, 188, 191,
+			26, 164, 188, 245, 93, 164, 187, 210, 164, 164, 187, 174, 233, 164, 188, 139,
+			26, 233, 190, 241, 93, 233, 187, 191, 164, 233, 187, 139, 233, 233, 184, 89,
+		};
+		JobSystem jobSystem(3);
+		const auto level = MipGenerator::Downsample(source, MipGenerator::Filter::Kaiser, true, &jobSystem);
+
+		CHECK(level.Width == 4);
+		CHECK(level.Height == 4);
+		CHECK(near_(REFERENCE, level.Pixels, 1));
+	}
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include "Test.h"
+#include "DescriptorSet.h"
+#include "JobSystem.h"
+#include "MemoryAllocator.h"
+#include "Mesh.h"
+#include "ParticleEffect.h"
+#include "StagingRing.h"
+#include "TransferManager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+namespace ParticleComputeTests
+{
+	// A Vulkan device without a surface: the first physical device with a queue family that supports both graphics and
+	// compute, which the TransferManager, the StagingRing and the dispatches all share.
+	struct HeadlessDevice
+	{
+		vk::UniqueInstance Instance;
+		VulkanDeviceContext DeviceContext;
+		vk::UniqueCommandPool CommandPool;
+
+		HeadlessDevice()
+		{
+			const vk::ApplicationInfo applicationInfo("VulkanParticlesComputeTests", VK_MAKE_VERSION(1, 0, 0),
+			                                          "VulkanParticles", VK_MAKE_VERSION(1, 0, 0), VK_API_VERSION_1_2);
+			Instance = vk::createInstanceUnique({{}, &applicationInfo});
+
+			for (const auto& physicalDevice : Instance->enumeratePhysicalDevices())
+			{
+				const auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+				for (uint32_t i = 0; i < queueFamilies.size(); ++i)
+				{
+					const auto required = vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute;
+					if (queueFamilies[i].queueCount > 0 && (queueFamilies[i].queueFlags & required) == required)
+					{
+						createDevice_(physicalDevice, i);
+						return;
+					}
+				}
+			}
+
+			throw std::runtime_error(
+				"Could not find a Vulkan device with a graphics and compute queue. Set VK_ICD_FILENAMES to a software implementation, like lavapipe, on machines without a GPU.");
+		}
+
+		~HeadlessDevice()
+		{
+			DeviceContext.LogicalDevice->waitIdle();
+		}
+
+	private:
+		void createDevice_(const vk::PhysicalDevice physicalDevice, const uint32_t queueFamily)
+		{
+			const auto queuePriority = 1.0f;
+			const vk::DeviceQueueCreateInfo queueCreateInfo({}, queueFamily, 1, &queuePriority);
+			// Destroyed once the last Buffer, and everything else that copied the VulkanDeviceContext, is gone.
+			DeviceContext.LogicalDevice = std::shared_ptr<vk::Device>(
+				new vk::Device(physicalDevice.createDevice({{}, 1, &queueCreateInfo})), [](vk::Device* device)
+				{
+					device->destroy();
+					delete device;
+				});
+			DeviceContext.PhysicalDevice = std::make_shared<vk::PhysicalDevice>(physicalDevice);
+			DeviceContext.GraphicsQueue = std::make_shared<vk::Queue>(
+				DeviceContext.LogicalDevice->getQueue(queueFamily, 0));
+			DeviceContext.PresentQueue = DeviceContext.GraphicsQueue;
+			DeviceContext.TransferQueue = DeviceContext.GraphicsQueue;
+			DeviceContext.GraphicsQueueFamily = queueFamily;
+			DeviceContext.TransferQueueFamily = queueFamily;
+			DeviceContext.Allocator = std::make_shared<MemoryAllocator>(DeviceContext.PhysicalDevice,
+			                                                            DeviceContext.LogicalDevice);
+			DeviceContext.Transfers = std::make_shared<TransferManager>(DeviceContext.LogicalDevice,
+			                                                            DeviceContext.TransferQueue, queueFamily,
+			                                                            DeviceContext.GraphicsQueue, queueFamily);
+			CommandPool = DeviceContext.LogicalDevice->createCommandPoolUnique({
+				vk::CommandPoolCreateFlagBits::eResetCommandBuffer, queueFamily
+			});
+			DeviceContext.Staging = std::make_shared<StagingRing>(DeviceContext, CommandPool);
+		}
+	};
+
+	// The compute pipeline VulkanContext::CreateComputePipeline() creates, with a single descriptor set.
+	struct ComputePipeline
+	{
+		vk::UniqueDescriptorSetLayout DescriptorSetLayout;
+		vk::UniquePipelineLayout PipelineLayout;
+		vk::UniquePipeline Pipeline;
+		vk::UniqueDescriptorPool DescriptorPool;
+		std::shared_ptr<DescriptorSet> Descriptors;
+
+		ComputePipeline(HeadlessDevice& device, const ParticleEffect& particleEffect)
+		{
+			auto& logicalDevice = *device.DeviceContext.LogicalDevice;
+			const auto bindings = ParticleEffect::GetComputeDescriptorSetLayoutBindings();
+			DescriptorSetLayout = logicalDevice.createDescriptorSetLayoutUnique({
+				{}, static_cast<uint32_t>(bindings.size()), &bindings[0]
+			});
+			const vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eCompute, 0,
+			                                              sizeof(ParticleEffect::ComputePushConstants));
+			PipelineLayout = logicalDevice.createPipelineLayoutUnique({
+				{}, 1, &DescriptorSetLayout.get(), 1, &pushConstantRange
+			});
+
+			const auto shaderCode = readShader_("assets/shaders/particle_comp.spv");
+			auto shaderModule = logicalDevice.createShaderModuleUnique({
+				{}, shaderCode.size() * sizeof(uint32_t), &shaderCode[0]
+			});
+			Pipeline = logicalDevice.createComputePipelineUnique(nullptr, {
+				{}, {{}, vk::ShaderStageFlagBits::eCompute, shaderModule.get(), "main"}, PipelineLayout.get()
+			});
+
+			const vk::DescriptorPoolSize poolSize(vk::DescriptorType::eStorageBuffer,
+			                                      static_cast<uint32_t>(bindings.size()));
+			DescriptorPool = logicalDevice.createDescriptorPoolUnique({
+				vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, 1, 1, &poolSize
+			});
+			Descriptors = std::make_shared<DescriptorSet>(device.DeviceContext, DescriptorPool, 1,
+			                                              DescriptorSetLayout.get());
+
+			auto stateBufferInfo = particleEffect.GetStateBuffer()->GenerateDescriptorBufferInfo();
+			auto instanceBufferInfo = particleEffect.GetInstanceBuffer()->GenerateDescriptorBufferInfo();
+			auto spawnCounterBufferInfo = particleEffect.GetSpawnCounterBuffer()->GenerateDescriptorBufferInfo();
+			std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+				{nullptr, 0, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &stateBufferInfo},
+				{nullptr, 1, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &instanceBufferInfo},
+				{nullptr, 2, 0, 1, vk::DescriptorType::eStorageBuffer, {}, &spawnCounterBufferInfo}
+			};
+			Descriptors->Update(0, descriptorWrites);
+		}
+
+	private:
+		static std::vector<uint32_t> readShader_(const std::string& filename)
+		{
+			std::ifstream file(filename, std::ios::binary);
+			if (!file.is_open())
+			{
+				throw std::runtime_error("Failed to open file with filename [" + filename +
+					"]. Run the tests from the repository root.");
+			}
+
+			const std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			std::vector<uint32_t> code(bytes.size() / sizeof(uint32_t));
+			memcpy(&code[0], &bytes[0], code.size() * sizeof(uint32_t));
+			return code;
+		}
+	};
+
+	// Orders particles by age, then by direction, which is unique per particle, so both paths sort the same way.
+	inline bool particleLess_(const ParticleEffect::GpuParticle& left, const ParticleEffect::GpuParticle& right)
+	{
+		return std::make_tuple(-left.VelocityLife.w, left.VelocityLife.x, left.VelocityLife.z) <
+			std::make_tuple(-right.VelocityLife.w, right.VelocityLife.x, right.VelocityLife.z);
+	}
+
+	inline std::vector<ParticleEffect::GpuParticle> cpuParticles_(const ParticleEffect& particleEffect)
+	{
+		const auto& particles = particleEffect.GetParticles();
+		std::vector<ParticleEffect::GpuParticle> result;
+		for (uint32_t i = 0; i < particles.GetAliveCount(); ++i)
+		{
+			const auto color = particles.GetColor(i);
+			result.push_back({
+				glm::vec4(particles.GetPosition(i), particles.GetSize(i)),
+				glm::vec4(particles.Data(ParticlePool::Attribute::VelocityX)[i],
+				          particles.Data(ParticlePool::Attribute::VelocityY)[i],
+				          particles.Data(ParticlePool::Attribute::VelocityZ)[i], color.a),
+				glm::vec4(glm::vec3(color), 0.0f)
+			});
+		}
+		std::sort(result.begin(), result.end(), particleLess_);
+		return result;
+	}
+
+	// Live particles of the readback of the compute effect's state buffer.
+	inline std::vector<ParticleEffect::GpuParticle> gpuParticles_(const Buffer& readback, const uint32_t capacity)
+	{
+		const auto slots = static_cast<const ParticleEffect::GpuParticle*>(readback.GetMappedData());
+		std::vector<ParticleEffect::GpuParticle> result;
+		std::copy_if(slots, slots + capacity, std::back_inserter(result),
+		             [](const ParticleEffect::GpuParticle& particle)
+		             {
+			             return particle.VelocityLife.w > 0.0f;
+		             });
+		std::sort(result.begin(), result.end(), particleLess_);
+		return result;
+	}
+
+	inline bool nearlyEqual_(const glm::vec4& left, const glm::vec4& right)
+	{
+		const auto tolerance = 1e-4f;
+		for (auto i = 0; i < 4; ++i)
+		{
+			if (std::abs(left[i] - right[i]) > tolerance)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Runs the same emitter through RenderMode::Instanced on the CPU and RenderMode::Compute on the GPU. The emitter
+	// saturates at maxAlive for a while and particles die and respawn, so the GPU spawn path is exercised both below and
+	// at the cap. Only normalize() may differ between the two paths, by a few ulps.
+	TEST_CASE(ComputeMatchesCpuSimulation)
+	{
+		const auto deltaTime = 0.5f;
+		const uint32_t steps = 150;
+		const uint32_t compareInterval = 25;
+		const ParticleEmitter emitter(240.0f, 3000, 500, 0x9E3779B97F4A7C15);
+		const glm::vec3 position(1.5f, -2.0f, 0.25f);
+
+		HeadlessDevice device;
+		auto& logicalDevice = *device.DeviceContext.LogicalDevice;
+		auto& queue = *device.DeviceContext.GraphicsQueue;
+		JobSystem jobSystem;
+		ParticleEffect cpuEffect(device.DeviceContext, device.CommandPool, 0, 0, 0, position, emitter, 0.1f, 1,
+		                         ParticleEffect::RenderMode::Instanced);
+		ParticleEffect gpuEffect(device.DeviceContext, device.CommandPool, 0, 0, 0, position, emitter, 0.1f, 1,
+		                         ParticleEffect::RenderMode::Compute);
+		ComputePipeline pipeline(device, gpuEffect);
+
+		const auto stateSize = emitter.GetMaxAlive() * sizeof(ParticleEffect::GpuParticle);
+		GenericBuffer readback(device.DeviceContext, device.CommandPool, stateSize,
+		                       vk::BufferUsageFlagBits::eTransferDst, vk::SharingMode::eExclusive,
+		                       vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		                       "ParticleComputeTests::readback");
+		auto commandBuffer = std::move(logicalDevice.allocateCommandBuffersUnique({
+			device.CommandPool.get(), vk::CommandBufferLevel::ePrimary, 1
+		})[0]);
+		auto fence = logicalDevice.createFenceUnique({});
+
+		for (uint32_t step = 1; step <= steps; ++step)
+		{
+			cpuEffect.Update(deltaTime, 0, jobSystem);
+			gpuEffect.Update(deltaTime, 0, jobSystem);
+			CHECK(gpuEffect.GetAliveCount() == cpuEffect.GetAliveCount());
+
+			commandBuffer->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+			commandBuffer->bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.Pipeline.get());
+			pipeline.Descriptors->Bind(0, pipeline.PipelineLayout, commandBuffer, vk::PipelineBindPoint::eCompute);
+			gpuEffect.Dispatch(commandBuffer, pipeline.PipelineLayout);
+
+			const auto compare = step % compareInterval == 0;
+			if (compare)
+			{
+				const vk::BufferMemoryBarrier copyBarrier(vk::AccessFlagBits::eShaderWrite,
+				                                          vk::AccessFlagBits::eTransferRead, VK_QUEUE_FAMILY_IGNORED,
+				                                          VK_QUEUE_FAMILY_IGNORED,
+				                                          gpuEffect.GetStateBuffer()->GetHandle(), 0, VK_WHOLE_SIZE);
+				commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+				                               vk::PipelineStageFlagBits::eTransfer, {}, nullptr, copyBarrier,
+				                               nullptr);
+				commandBuffer->copyBuffer(gpuEffect.GetStateBuffer()->GetHandle(), readback.GetHandle(),
+				                          vk::BufferCopy(0, 0, stateSize));
+				const vk::BufferMemoryBarrier hostBarrier(vk::AccessFlagBits::eTransferWrite,
+				                                          vk::AccessFlagBits::eHostRead, VK_QUEUE_FAMILY_IGNORED,
+				                                          VK_QUEUE_FAMILY_IGNORED, readback.GetHandle(), 0,
+				                                          VK_WHOLE_SIZE);
+				commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+				                               {}, nullptr, hostBarrier, nullptr);
+			}
+			commandBuffer->end();
+
+			// The initial uploads are submitted ahead of the first dispatch, as VulkanContext::SubmitFrame() does.
+			device.DeviceContext.Transfers->Flush();
+			queue.submit(vk::SubmitInfo(0, nullptr, nullptr, 1, &commandBuffer.get()), fence.get());
+			CHECK(logicalDevice.waitForFences(fence.get(), VK_TRUE, UINT64_MAX) == vk::Result::eSuccess);
+			logicalDevice.resetFences(fence.get());
+			device.DeviceContext.Transfers->Collect();
+
+			if (!compare)
+			{
+				continue;
+			}
+
+			const auto expected = cpuParticles_(cpuEffect);
+			const auto actual = gpuParticles_(readback, emitter.GetMaxAlive());
+			CHECK(actual.size() == expected.size());
+			for (size_t i = 0; i < expected.size(); ++i)
+			{
+				CHECK(nearlyEqual_(actual[i].PositionSize, expected[i].PositionSize));
+				CHECK(nearlyEqual_(actual[i].VelocityLife, expected[i].VelocityLife));
+				CHECK(nearlyEqual_(actual[i].Color, expected[i].Color));
+			}
+		}
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Test.h"
+#include "ParticleKernels.h"
+
+#include <cstring>
+#include <random>
+
+namespace ParticleKernelsTests
+{
+	static const uint32_t CAPACITY = 1021;
+
+	// Fills every stream with values in [-8, 8), so positions, velocities and life all cover a few binades and signs.
+	static void fill_(ParticlePool& pool, const uint64_t seed)
+	{
+		std::mt19937_64 random(seed);
+		std::uniform_real_distribution<float> distribution(-8.0f, 8.0f);
+		for (uint32_t attribute = 0; attribute < static_cast<uint32_t>(ParticlePool::Attribute::Count); ++attribute)
+		{
+			auto* values = pool.Data(static_cast<ParticlePool::Attribute>(attribute));
+			for (uint32_t i = 0; i < pool.GetCapacity(); ++i)
+			{
+				values[i] = distribution(random);
+			}
+		}
+	}
+
+	static bool streamsEqual_(const ParticlePool& expected, const ParticlePool& actual)
+	{
+		for (uint32_t attribute = 0; attribute < static_cast<uint32_t>(ParticlePool::Attribute::Count); ++attribute)
+		{
+			const auto stream = static_cast<ParticlePool::Attribute>(attribute);
+			if (std::memcmp(expected.Data(stream), actual.Data(stream), expected.GetCapacity() * sizeof(float)) != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Rounds the product before the add, which no compiler can contract into an FMA.
+	static void integrateReference_(ParticlePool& pool, const uint32_t begin, const uint32_t end, const float step)
+	{
+		const std::array<std::pair<ParticlePool::Attribute, ParticlePool::Attribute>, 3> axes = {
+			std::make_pair(ParticlePool::Attribute::PositionX, ParticlePool::Attribute::VelocityX),
+			std::make_pair(ParticlePool::Attribute::PositionY, ParticlePool::Attribute::VelocityY),
+			std::make_pair(ParticlePool::Attribute::PositionZ, ParticlePool::Attribute::VelocityZ)
+		};
+		for (auto i = begin; i < end; ++i)
+		{
+			for (const auto& [position, velocity] : axes)
+			{
+				const volatile auto product = pool.Data(velocity)[i] * step;
+				pool.Data(position)[i] = pool.Data(position)[i] + product;
+			}
+			pool.Data(ParticlePool::Attribute::Life)[i] = pool.Data(ParticlePool::Attribute::Life)[i] - step;
+		}
+	}
+
+	// The scalar kernel and every instruction set this CPU supports have to match the reference bit for bit, including
+	// ranges that start and end off a lane boundary, and leave the particles outside [begin, end) untouched.
+	TEST_CASE(IntegrateMatchesReferenceBitForBit)
+	{
+		const auto detected = ParticleKernels::DetectInstructionSet();
+		const std::array<float, 3> steps = {0.016f, 0.05f * 0.0137f, 1.0f / 3.0f};
+		const std::array<std::pair<uint32_t, uint32_t>, 4> ranges = {
+			std::make_pair(0u, CAPACITY), std::make_pair(3u, CAPACITY - 5), std::make_pair(17u, 18u),
+			std::make_pair(5u, 5u)
+		};
+
+		for (auto instructionSet = static_cast<int>(ParticleKernels::InstructionSet::Scalar);
+		     instructionSet <= static_cast<int>(detected); ++instructionSet)
+		{
+			const auto kernel = ParticleKernels::GetIntegrateKernel(
+				static_cast<ParticleKernels::InstructionSet>(instructionSet));
+			for (const auto& [begin, end] : ranges)
+			{
+				ParticlePool expected(CAPACITY);
+				ParticlePool actual(CAPACITY);
+				fill_(expected, begin);
+				fill_(actual, begin);
+				for (const auto step : steps)
+				{
+					integrateReference_(expected, begin, end, step);
+					kernel(actual, begin, end, step);
+				}
+				CHECK(streamsEqual_(expected, actual));
+			}
+		}
+	}
+
+	TEST_CASE(IntegrateScalarComputesPositionAndLife)
+	{
+		ParticlePool pool(1);
+		pool.Add(glm::vec3(1.0f, 2.0f, 3.0f), glm::vec3(0.5f, -1.0f, 2.0f), glm::vec3(1.0f), 1.0f);
+		ParticleKernels::IntegrateScalar(pool, 0, 1, 0.25f);
+		CHECK(pool.GetPosition(0).x == 1.125f);
+		CHECK(pool.GetPosition(0).y == 1.75f);
+		CHECK(pool.GetPosition(0).z == 3.5f);
+		CHECK(pool.GetColor(0).a == 0.75f);
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal test harness for VulkanParticlesTests. Every TEST_CASE registers itself on static initialization, and
+// tests/main.cpp runs them all. A failed CHECK throws, which fails only the test case it is in.
+namespace Test
+{
+	class Failure : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	using Case = std::pair<std::string, std::function<void()>>;
+
+	inline std::vector<Case>& Cases()
+	{
+		static std::vector<Case> cases;
+		return cases;
+	}
+
+	struct Registrar
+	{
+		Registrar(const char* name, std::function<void()> body)
+		{
+			Cases().emplace_back(name, std::move(body));
+		}
+	};
+
+	inline void Check(const bool condition, const char* expression, const char* file, const int line)
+	{
+		if (!condition)
+		{
+			throw Failure(std::string(file) + "(" + std::to_string(line) + "): CHECK(" + expression + ") failed.");
+		}
+	}
+
+	// Runs every registered test case. Returns the number that failed.
+	inline int RunAll()
+	{
+		auto failed = 0;
+		for (const auto& [name, body] : Cases())
+		{
+			try
+			{
+				body();
+				std::cout << "[PASS] " << name << std::endl;
+			}
+			catch (const std::exception& exception)
+			{
+				std::cerr << "[FAIL] " << name << ": " << exception.what() << std::endl;
+				++failed;
+			}
+		}
+
+		std::cout << Cases().size() - failed << "/" << Cases().size() << " test cases passed." << std::endl;
+		return failed;
+	}
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static const Test::Registrar name##Registrar_(#name, name); \
+	static void name()
+
+#define CHECK(expression) Test::Check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
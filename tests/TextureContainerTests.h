@@ -0,0 +1,164 @@
+#pragma once
+
+#include "Test.h"
+#include "TextureContainer.h"
+
+#include <cstddef>
+#include <cstdio>
+
+namespace TextureContainerTests
+{
+	static const std::string FILENAME = "TextureContainerTests" + TextureContainer::EXTENSION;
+
+	// Writes a width x height RGBA8 container with mipLevels levels, where every byte of level i is i.
+	static void write_(const uint32_t width, const uint32_t height, const uint32_t mipLevels)
+	{
+		std::vector<std::vector<unsigned char>> levels;
+		std::vector<vk::Extent2D> extents;
+		for (uint32_t i = 0; i < mipLevels; ++i)
+		{
+			const vk::Extent2D extent{std::max(width >> i, 1u), std::max(height >> i, 1u)};
+			levels.emplace_back(extent.width * extent.height * 4, static_cast<unsigned char>(i));
+			extents.push_back(extent);
+		}
+		TextureContainer::Write(FILENAME, vk::Format::eR8G8B8A8Unorm, levels, extents);
+	}
+
+	// Overwrites the bytes of value at offset in the written container, to corrupt one of its fields.
+	template <typename T>
+	static void patch_(const uint64_t offset, const T value)
+	{
+		std::fstream file(FILENAME, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(static_cast<std::streamoff>(offset));
+		file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	static uint64_t levelOffset_(const uint32_t level, const size_t field)
+	{
+		return sizeof(TextureContainer::Header) + level * sizeof(TextureContainer::Level) + field;
+	}
+
+	static bool openingThrows_()
+	{
+		try
+		{
+			TextureContainer container(FILENAME);
+		}
+		catch (const std::runtime_error&)
+		{
+			return true;
+		}
+		return false;
+	}
+
+	TEST_CASE(WriteThenLoadRoundTrips)
+	{
+		write_(8, 2, 4);
+		TextureContainer container(FILENAME);
+		container.Load();
+		std::remove(FILENAME.c_str());
+
+		CHECK(container.GetHeader().Width == 8);
+		CHECK(container.GetHeader().Height == 2);
+		CHECK(container.GetLevels().size() == 4);
+		std::vector<unsigned char> data(static_cast<size_t>(container.GetHeader().DataSize));
+		container.Read(data.data());
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			const auto& level = container.GetLevels()[i];
+			CHECK(level.Width == std::max(8u >> i, 1u));
+			CHECK(level.Height == std::max(2u >> i, 1u));
+			CHECK(level.Offset % TextureContainer::DATA_ALIGNMENT == 0);
+			CHECK(level.Size == level.Width * level.Height * 4);
+			for (uint64_t byte = level.Offset; byte < level.Offset + level.Size; ++byte)
+			{
+				CHECK(data[static_cast<size_t>(byte)] == i);
+			}
+		}
+	}
+
+	TEST_CASE(RejectsInvalidMipLevels)
+	{
+		write_(8, 8, 4);
+		patch_<uint32_t>(offsetof(TextureContainer::Header, MipLevels), 0);
+		CHECK(openingThrows_());
+
+		// Beyond the 4 levels of an 8x8 chain, and far too many to allocate a level table for.
+		write_(8, 8, 4);
+		patch_<uint32_t>(offsetof(TextureContainer::Header, MipLevels), 5);
+		CHECK(openingThrows_());
+		patch_<uint32_t>(offsetof(TextureContainer::Header, MipLevels), 0xFFFFFFFF);
+		CHECK(openingThrows_());
+		std::remove(FILENAME.c_str());
+	}
+
+	TEST_CASE(RejectsDataOutsideOfFile)
+	{
+		write_(8, 8, 4);
+		patch_<uint64_t>(offsetof(TextureContainer::Header, DataSize), 0xFFFFFFFFFFFF);
+		CHECK(openingThrows_());
+
+		write_(8, 8, 4);
+		patch_<uint64_t>(levelOffset_(3, offsetof(TextureContainer::Level, Size)), 4096);
+		CHECK(openingThrows_());
+
+		// Large enough for Offset + Size to wrap around.
+		write_(8, 8, 4);
+		patch_<uint64_t>(levelOffset_(1, offsetof(TextureContainer::Level, Offset)), 0xFFFFFFFFFFFFFFF0);
+		CHECK(openingThrows_());
+		std::remove(FILENAME.c_str());
+	}
+
+	TEST_CASE(RejectsLevelSizesThatDontMatchFormat)
+	{
+		// Still inside of the data, but short of the 4x4 level's 64 bytes.
+		write_(8, 8, 4);
+		patch_<uint64_t>(levelOffset_(1, offsetof(TextureContainer::Level, Size)), 16);
+		CHECK(openingThrows_());
+
+		// BC1 levels are whole 8-byte blocks, so the 2x2 and 1x1 levels take one block each.
+		TextureContainer::Write(FILENAME, vk::Format::eBc1RgbaUnormBlock,
+		                        {std::vector<unsigned char>(32), std::vector<unsigned char>(8),
+		                         std::vector<unsigned char>(8), std::vector<unsigned char>(8)},
+		                        {{8, 8}, {4, 4}, {2, 2}, {1, 1}});
+		CHECK(!openingThrows_());
+		patch_<uint64_t>(levelOffset_(2, offsetof(TextureContainer::Level, Size)), 2 * 2 * 4);
+		CHECK(openingThrows_());
+		std::remove(FILENAME.c_str());
+	}
+
+	// Same texel size as eR8G8B8A8Unorm, but TextureCooker never writes it.
+	TEST_CASE(RejectsUnsupportedFormat)
+	{
+		write_(8, 8, 4);
+		patch_<uint32_t>(offsetof(TextureContainer::Header, Format), static_cast<uint32_t>(vk::Format::eR8G8B8A8Srgb));
+		CHECK(openingThrows_());
+		std::remove(FILENAME.c_str());
+	}
+
+	TEST_CASE(RejectsLevelExtentsOutsideOfMipChain)
+	{
+		write_(8, 4, 4);
+		patch_<uint32_t>(levelOffset_(1, offsetof(TextureContainer::Level, Width)), 8);
+		CHECK(openingThrows_());
+
+		write_(8, 4, 4);
+		patch_<uint32_t>(levelOffset_(3, offsetof(TextureContainer::Level, Height)), 0);
+		CHECK(openingThrows_());
+		std::remove(FILENAME.c_str());
+	}
+
+	TEST_CASE(WriteRejectsMissingLevels)
+	{
+		auto threw = false;
+		try
+		{
+			TextureContainer::Write(FILENAME, vk::Format::eR8G8B8A8Unorm, {}, {});
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+}
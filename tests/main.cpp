@@ -0,0 +1,14 @@
+#include "stdafx.h"
+#include "Test.h"
+
+#include "BlockCompressionTests.h"
+#include "JobSystemTests.h"
+#include "MipGeneratorTests.h"
+#include "ParticleKernelsTests.h"
+#include "TextureContainerTests.h"
+
+// Unit tests for the parts of VulkanParticles that don't need a GPU. Exits with the number of failed test cases.
+int main()
+{
+	return Test::RunAll();
+}